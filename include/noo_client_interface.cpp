@@ -226,6 +226,50 @@ void BufferDelegate::prepare_delete() { }
 
 // =============================================================================
 
+bool TableFilter::empty() const {
+    return columns.empty() and ranges.empty() and equals.empty();
+}
+
+noo::AnyVar TableFilter::to_any() const {
+    noo::AnyVarMap ret;
+
+    if (!columns.empty()) {
+        noo::AnyVarList l;
+
+        for (auto const& c : columns) {
+            l.emplace_back(std::string_view(c));
+        }
+
+        ret["columns"] = std::move(l);
+    }
+
+    noo::AnyVarList where;
+
+    for (auto const& r : ranges) {
+        noo::AnyVarMap m;
+
+        m["column"] = std::string_view(r.column);
+
+        if (r.min) m["min"] = *r.min;
+        if (r.max) m["max"] = *r.max;
+
+        where.emplace_back(std::move(m));
+    }
+
+    for (auto const& e : equals) {
+        noo::AnyVarMap m;
+
+        m["column"] = std::string_view(e.column);
+        m["equals"] = std::string_view(e.value);
+
+        where.emplace_back(std::move(m));
+    }
+
+    if (!where.empty()) ret["where"] = std::move(where);
+
+    return ret;
+}
+
 TableDelegate::TableDelegate(noo::TableID i, TableData const& data)
     : m_id(i), m_attached_methods(this), m_attached_signals(this) {
 
@@ -256,6 +300,8 @@ void TableDelegate::update(TableData const& data) {
 
         find_sig("tbl_reset", &TableDelegate::interp_table_reset);
         find_sig("tbl_updated", &TableDelegate::interp_table_update);
+        find_sig("tbl_updated_columnar",
+                 &TableDelegate::interp_table_update_columnar);
         find_sig("tbl_rows_removed", &TableDelegate::interp_table_remove);
         find_sig("tbl_selection_updated",
                  &TableDelegate::interp_table_sel_update);
@@ -285,24 +331,102 @@ void TableDelegate::on_table_initialize(noo::AnyVarListRef const&,
 
 void TableDelegate::on_table_reset() { }
 void TableDelegate::on_table_updated(noo::AnyVarRef, noo::AnyVarRef) { }
+void TableDelegate::on_table_initialize_columnar(noo::AnyVarListRef const&,
+                                                 noo::ColumnarTable const&,
+                                                 noo::AnyVarListRef const&) { }
+void TableDelegate::on_table_updated_columnar(noo::ColumnarTable const&) { }
 void TableDelegate::on_table_rows_removed(noo::AnyVarRef) { }
 void TableDelegate::on_table_selection_updated(std::string_view,
                                                noo::SelectionRef const&) { }
+void TableDelegate::on_table_selection_changed(std::string_view   name,
+                                               noo::RowSet const& selection,
+                                               noo::RowSet const&,
+                                               noo::RowSet const&) {
+    // delegates written against the whole selection callback still hear
+    // about changes; those that override this do not pay for the copy
+    noo::SelectionRef whole;
+    whole.rows = selection.to_vector();
 
-PendingMethodReply* TableDelegate::subscribe() const {
-    auto* p = attached_methods().new_call_by_name<SubscribeInitReply>(
-        "tbl_subscribe");
+    this->on_table_selection_updated(name, whole);
+}
+
+void TableDelegate::read_selections(noo::AnyVarListRef const& sels) const {
+    m_selections.clear();
+
+    sels.for_each([this](auto, noo::AnyVarRef const& r) {
+        auto entry = r.to_vector();
+
+        if (entry.size() < 2) return;
+
+        m_selections[std::string(entry[0].to_string())] =
+            noo::RowSet(noo::SelectionRef(entry[1]));
+    });
+}
+
+PendingMethodReply*
+TableDelegate::start_subscription(std::string_view   method,
+                                  noo::AnyVarList&&  args,
+                                  bool               columnar,
+                                  TableFilter const& filter) const {
+    auto* p = attached_methods().new_call_by_name<SubscribeInitReply>(method);
+
+    if (!p) return nullptr;
+
+    // first, so that the handlers below can already look at selections
+    connect(p,
+            &SubscribeInitReply::recv,
+            this,
+            [this](noo::AnyVarListRef const&,
+                   noo::AnyVarRef,
+                   noo::AnyVarListRef const&,
+                   noo::AnyVarListRef const& sels) { read_selections(sels); });
+
+    connect(p,
+            &SubscribeInitReply::recv_columnar,
+            this,
+            [this](noo::AnyVarListRef const&,
+                   noo::ColumnarTable const&,
+                   noo::AnyVarListRef const& sels) { read_selections(sels); });
 
     connect(p,
             &SubscribeInitReply::recv,
             this,
             &TableDelegate::on_table_initialize);
 
-    p->call();
+    connect(p,
+            &SubscribeInitReply::recv_columnar,
+            this,
+            &TableDelegate::on_table_initialize_columnar);
+
+    m_columnar = columnar;
+
+    if (columnar or !filter.empty()) {
+        args.emplace_back(std::string_view(columnar ? "columnar" : ""));
+    }
+
+    if (!filter.empty()) args.emplace_back(filter.to_any());
+
+    p->call_direct(std::move(args));
 
     return p;
 }
 
+PendingMethodReply* TableDelegate::subscribe(bool               columnar,
+                                             TableFilter const& filter) const {
+    return start_subscription("tbl_subscribe", {}, columnar, filter);
+}
+
+PendingMethodReply*
+TableDelegate::subscribe_window(int64_t            offset,
+                                int64_t            limit,
+                                bool               columnar,
+                                TableFilter const& filter) const {
+    return start_subscription("tbl_subscribe_window",
+                              noo::marshall_to_any(offset, limit),
+                              columnar,
+                              filter);
+}
+
 
 PendingMethodReply*
 TableDelegate::request_row_insert(noo::AnyVarList&& row) const {
@@ -372,6 +496,22 @@ TableDelegate::request_selection_update(std::string_view name,
     return p;
 }
 
+PendingMethodReply*
+TableDelegate::request_selection_update(std::string_view   name,
+                                        noo::RowSet const& selection) const {
+    auto* p = attached_methods().new_call_by_name("tbl_update_selection");
+
+    p->call(name, selection.to_any());
+
+    return p;
+}
+
+noo::RowSet const* TableDelegate::selection(std::string_view name) const {
+    auto iter = m_selections.find(std::string(name));
+
+    return iter == m_selections.end() ? nullptr : &iter->second;
+}
+
 void TableDelegate::interp_table_reset(noo::AnyVarListRef const&) {
     this->on_table_reset();
 }
@@ -383,12 +523,29 @@ void TableDelegate::interp_table_update(noo::AnyVarListRef const& ref) {
         return;
     }
 
+    // other clients may have subscribed the other way
+    if (m_columnar) return;
+
     auto keylist = ref[0];
     auto cols    = ref[1];
 
     this->on_table_updated(keylist, cols);
 }
 
+void TableDelegate::interp_table_update_columnar(
+    noo::AnyVarListRef const& ref) {
+    if (!m_columnar) return;
+
+    noo::ColumnarTable table;
+
+    if (ref.size() < 1 or !table.decode(ref[0].to_data())) {
+        qWarning() << Q_FUNC_INFO << "Malformed signal from server";
+        return;
+    }
+
+    this->on_table_updated_columnar(table);
+}
+
 void TableDelegate::interp_table_remove(noo::AnyVarListRef const& ref) {
     if (ref.size() < 1) {
         qWarning() << Q_FUNC_INFO << "Malformed signal from server";
@@ -404,10 +561,34 @@ void TableDelegate::interp_table_sel_update(noo::AnyVarListRef const& ref) {
         return;
     }
 
-    auto str     = ref[0].to_string();
-    auto sel_ref = noo::SelectionRef(ref[1]);
+    auto str    = ref[0].to_string();
+    auto change = ref[1].to_map();
+
+    if (!change.count("added") and !change.count("removed")) {
+        // a whole selection
+        auto sel_ref = noo::SelectionRef(ref[1]);
+
+        m_selections[std::string(str)] = noo::RowSet(sel_ref);
+
+        this->on_table_selection_updated(str, sel_ref);
+        return;
+    }
+
+    noo::RowSet added;
+    noo::RowSet removed;
+
+    if (!added.decode(change["added"].to_data()) or
+        !removed.decode(change["removed"].to_data())) {
+        qWarning() << Q_FUNC_INFO << "Malformed signal from server";
+        return;
+    }
+
+    auto& current = m_selections[std::string(str)];
+
+    current -= removed;
+    current |= added;
 
-    this->on_table_selection_updated(str, sel_ref);
+    this->on_table_selection_changed(str, current, added, removed);
 }
 
 
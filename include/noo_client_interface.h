@@ -625,6 +625,35 @@ struct TableData {
     std::optional<std::vector<SignalDelegatePtr>> signal_list;
 };
 
+///
+/// \brief The TableFilter struct narrows a table subscription to some of the
+/// columns, and to the rows that pass every predicate.
+///
+struct TableFilter {
+    /// Names of the columns to send. Empty for all.
+    std::vector<std::string> columns;
+
+    /// A real column must be within the given bounds
+    struct Range {
+        std::string           column;
+        std::optional<double> min;
+        std::optional<double> max;
+    };
+
+    /// A string column must equal a value
+    struct Equals {
+        std::string column;
+        std::string value;
+    };
+
+    std::vector<Range>  ranges;
+    std::vector<Equals> equals;
+
+    bool empty() const;
+
+    noo::AnyVar to_any() const;
+};
+
 class TableDelegate : public QObject {
     Q_OBJECT
     noo::TableID       m_id;
@@ -633,6 +662,19 @@ class TableDelegate : public QObject {
 
     std::vector<QMetaObject::Connection> m_spec_signals;
 
+    // set by subscribe(); picks which update signal we listen to
+    mutable bool m_columnar = false;
+
+    // the server only sends changes, so we keep the selections here
+    mutable std::unordered_map<std::string, noo::RowSet> m_selections;
+
+    void read_selections(noo::AnyVarListRef const&) const;
+
+    PendingMethodReply* start_subscription(std::string_view method,
+                                           noo::AnyVarList&& args,
+                                           bool              columnar,
+                                           TableFilter const& filter) const;
+
 public:
     TableDelegate(noo::TableID, TableData const&);
     virtual ~TableDelegate();
@@ -658,12 +700,42 @@ public slots:
 
     virtual void on_table_reset();
     virtual void on_table_updated(noo::AnyVarRef keys, noo::AnyVarRef columns);
+
+    /// Columnar versions of the above, used if subscribed that way. String
+    /// columns refer to the message, and are only valid during the call.
+    virtual void on_table_initialize_columnar(noo::AnyVarListRef const& names,
+                                              noo::ColumnarTable const& data,
+                                              noo::AnyVarListRef const& sels);
+    virtual void on_table_updated_columnar(noo::ColumnarTable const&);
+
     virtual void on_table_rows_removed(noo::AnyVarRef keys);
+    /// A selection has been replaced, or has changed, with the whole
+    /// selection given as rows. Kept for existing delegates; new code should
+    /// override on_table_selection_changed() instead.
     virtual void on_table_selection_updated(std::string_view,
                                             noo::SelectionRef const&);
 
+    /// A selection has changed. The whole selection is given, along with the
+    /// keys that were added and removed. The default calls
+    /// on_table_selection_updated() with the whole selection.
+    virtual void on_table_selection_changed(std::string_view,
+                                            noo::RowSet const& selection,
+                                            noo::RowSet const& added,
+                                            noo::RowSet const& removed);
+
 public:
-    PendingMethodReply* subscribe() const;
+    /// Subscribe to the table. If columnar is set, the initial data and
+    /// updates are delivered as ColumnarTable blocks. A filter, evaluated by
+    /// the server, limits what is delivered.
+    PendingMethodReply* subscribe(bool               columnar = false,
+                                  TableFilter const& filter   = {}) const;
+
+    /// Subscribe to a window of rows. Only the window is delivered, and only
+    /// updates that touch it. Call again to move the window.
+    PendingMethodReply* subscribe_window(int64_t            offset,
+                                         int64_t            limit,
+                                         bool               columnar = false,
+                                         TableFilter const& filter = {}) const;
     PendingMethodReply* request_row_insert(noo::AnyVarList&& row) const;
     PendingMethodReply* request_rows_insert(noo::AnyVarList&& columns) const;
 
@@ -677,10 +749,17 @@ public:
     PendingMethodReply* request_clear() const;
     PendingMethodReply* request_selection_update(std::string_view,
                                                  noo::Selection) const;
+    PendingMethodReply* request_selection_update(std::string_view,
+                                                 noo::RowSet const&) const;
+
+    /// The current state of a selection, as of the last subscription or
+    /// change. Null if there is no such selection.
+    noo::RowSet const* selection(std::string_view) const;
 
 private slots:
     void interp_table_reset(noo::AnyVarListRef const&);
     void interp_table_update(noo::AnyVarListRef const&);
+    void interp_table_update_columnar(noo::AnyVarListRef const&);
     void interp_table_remove(noo::AnyVarListRef const&);
     void interp_table_sel_update(noo::AnyVarListRef const&);
 
@@ -4,6 +4,11 @@
 
 #include <QDebug>
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
 namespace noo {
 
 Selection::Selection(AnyVar&& v) {
@@ -14,7 +19,7 @@ Selection::Selection(AnyVar&& v) {
     auto raw_ranges_list =
         steal_or_default(raw_obj, "row_ranges").coerce_int_list();
 
-    row_ranges.reserve(raw_ranges_list.size() / 2);
+    row_ranges.resize(raw_ranges_list.size() / 2);
 
     assert(row_ranges.size() * 2 == raw_ranges_list.size());
 
@@ -31,8 +36,8 @@ AnyVar Selection::to_any() const {
 
     std::span<int64_t> ls((int64_t*)row_ranges.data(), row_ranges.size() * 2);
 
-    map["selected_rows"]       = rows;
-    map["selected_row_ranges"] = ls;
+    map["rows"]       = rows;
+    map["row_ranges"] = ls;
 
     return ret;
 }
@@ -46,6 +51,7 @@ SelectionRef::SelectionRef(AnyVarRef const& s) {
 
     rows       = steal_or_default(raw_obj, "rows").coerce_int_list();
     raw_ranges = steal_or_default(raw_obj, "row_ranges").coerce_int_list();
+    row_set    = steal_or_default(raw_obj, "row_set").to_data();
 
     // turn the contiguous span into a pair span
 
@@ -57,8 +63,8 @@ AnyVar SelectionRef::to_any() const {
 
     auto& map = ret.emplace<AnyVarMap>();
 
-    map["selected_rows"]       = rows.span();
-    map["selected_row_ranges"] = cast_span_to<int64_t const>(row_ranges);
+    map["rows"]       = rows.span();
+    map["row_ranges"] = cast_span_to<int64_t const>(row_ranges);
 
     return ret;
 }
@@ -73,6 +79,823 @@ Selection SelectionRef::to_selection() const {
 
 //==============================================================================
 
+// =============================================================================
+
+namespace {
+
+// arrays are copied to and from the wire as they are in memory
+static_assert(std::endian::native == std::endian::little);
+
+constexpr size_t   columnar_header_size = 24;
+constexpr uint32_t columnar_version     = 1;
+constexpr uint64_t columnar_reals       = 0;
+constexpr uint64_t columnar_strings     = 1;
+constexpr uint64_t columnar_dictionary  = 2;
+
+size_t pad_to_8(size_t v) {
+    return (v + 7) & ~size_t(7);
+}
+
+/// Reads sections from an encoded table, failing instead of running off the
+/// end.
+struct ColumnarReader {
+    std::span<std::byte const> bytes;
+    size_t                     at = 0;
+    bool                       ok = true;
+
+    std::span<std::byte const> take(size_t count) {
+        if (!ok or count > bytes.size() - at) {
+            ok = false;
+            return {};
+        }
+
+        auto ret = bytes.subspan(at, count);
+
+        // the padding after the last section may be left off
+        at = std::min(at + pad_to_8(count), bytes.size());
+
+        return ret;
+    }
+
+    template <class T>
+    bool take_into(std::vector<T>& dest, size_t count) {
+        if (count > bytes.size() / sizeof(T)) ok = false;
+
+        auto source = take(count * sizeof(T));
+
+        if (!ok) return false;
+
+        // the source may not be aligned
+        dest.resize(count);
+        std::memcpy(dest.data(), source.data(), source.size());
+
+        return true;
+    }
+
+    uint64_t take_u64() {
+        uint64_t ret    = 0;
+        auto     source = take(sizeof(ret));
+        if (ok) std::memcpy(&ret, source.data(), sizeof(ret));
+        return ret;
+    }
+};
+
+/// Read a run of strings: offsets, and then the blob
+bool take_strings(ColumnarReader&         reader,
+                  uint64_t                count,
+                  ColumnarTable::Strings& strings) {
+    if (!reader.take_into(strings.offsets, count + 1)) return false;
+
+    auto const& o = strings.offsets;
+
+    if (o.front() != 0 or !std::is_sorted(o.begin(), o.end())) return false;
+
+    auto blob = reader.take(o.back());
+    if (!reader.ok) return false;
+
+    strings.blob = std::string_view(reinterpret_cast<char const*>(blob.data()),
+                                    blob.size());
+
+    return true;
+}
+
+} // namespace
+
+size_t ColumnarTable::Strings::size() const {
+    return offsets.empty() ? 0 : offsets.size() - 1;
+}
+
+std::string_view ColumnarTable::Strings::at(size_t row) const {
+    return blob.substr(offsets[row], offsets[row + 1] - offsets[row]);
+}
+
+size_t ColumnarTable::Dictionary::size() const {
+    return codes.size();
+}
+
+std::string_view ColumnarTable::Dictionary::at(size_t row) const {
+    return entries.at(codes[row]);
+}
+
+bool ColumnarTable::decode(std::span<std::byte const> bytes) {
+    keys.clear();
+    columns.clear();
+
+    ColumnarReader reader { bytes };
+
+    auto header = reader.take(columnar_header_size);
+
+    if (!reader.ok or std::memcmp(header.data(), "NCOL", 4) != 0) return false;
+
+    uint32_t version;
+    uint64_t num_rows;
+    uint64_t num_cols;
+
+    std::memcpy(&version, header.data() + 4, sizeof(version));
+    std::memcpy(&num_rows, header.data() + 8, sizeof(num_rows));
+    std::memcpy(&num_cols, header.data() + 16, sizeof(num_cols));
+
+    if (version != columnar_version) return false;
+
+    // every row and column takes at least 8 bytes, which bounds bad counts
+    if (num_rows > bytes.size() / 8 or num_cols > bytes.size() / 8) {
+        return false;
+    }
+
+    if (!reader.take_into(keys, num_rows)) return false;
+
+    columns.reserve(num_cols);
+
+    for (uint64_t ci = 0; ci < num_cols; ci++) {
+        switch (reader.take_u64()) {
+        case columnar_reals: {
+            std::vector<double> reals;
+            if (!reader.take_into(reals, num_rows)) return false;
+            columns.emplace_back(std::move(reals));
+            break;
+        }
+        case columnar_strings: {
+            Strings strings;
+            if (!take_strings(reader, num_rows, strings)) return false;
+            columns.emplace_back(std::move(strings));
+            break;
+        }
+        case columnar_dictionary: {
+            Dictionary dictionary;
+
+            auto const num_entries = reader.take_u64();
+
+            if (num_entries > bytes.size() / 8) return false;
+
+            if (!take_strings(reader, num_entries, dictionary.entries) or
+                !reader.take_into(dictionary.codes, num_rows)) {
+                return false;
+            }
+
+            for (auto code : dictionary.codes) {
+                if (code < 0 or uint64_t(code) >= num_entries) return false;
+            }
+
+            columns.emplace_back(std::move(dictionary));
+            break;
+        }
+        default: return false;
+        }
+    }
+
+    return reader.ok;
+}
+
+ColumnarTableWriter::ColumnarTableWriter(size_t rows, size_t cols)
+    : m_rows(rows) {
+    auto header = grow(columnar_header_size);
+
+    uint32_t const version  = columnar_version;
+    uint64_t const num_rows = rows;
+    uint64_t const num_cols = cols;
+
+    std::memcpy(header.data(), "NCOL", 4);
+    std::memcpy(header.data() + 4, &version, sizeof(version));
+    std::memcpy(header.data() + 8, &num_rows, sizeof(num_rows));
+    std::memcpy(header.data() + 16, &num_cols, sizeof(num_cols));
+
+    grow(rows * sizeof(int64_t));
+}
+
+std::span<std::byte> ColumnarTableWriter::grow(size_t bytes) {
+    auto const at = m_bytes.size();
+
+    m_bytes.resize(at + pad_to_8(bytes));
+
+    return std::span(m_bytes).subspan(at, bytes);
+}
+
+void ColumnarTableWriter::add_kind(uint64_t kind) {
+    add_u64(kind);
+}
+
+void ColumnarTableWriter::add_u64(uint64_t v) {
+    std::memcpy(grow(sizeof(v)).data(), &v, sizeof(v));
+}
+
+void ColumnarTableWriter::write_strings(std::span<std::string_view const> v,
+                                        size_t count) {
+    uint64_t total = 0;
+
+    {
+        auto offsets =
+            cast_span_to<uint64_t>(grow((count + 1) * sizeof(uint64_t)));
+
+        offsets[0] = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            if (i < v.size()) total += v[i].size();
+            offsets[i + 1] = total;
+        }
+    }
+
+    auto blob = grow(total);
+
+    size_t at = 0;
+
+    for (size_t i = 0; i < std::min(count, v.size()); i++) {
+        std::memcpy(blob.data() + at, v[i].data(), v[i].size());
+        at += v[i].size();
+    }
+}
+
+std::span<int64_t> ColumnarTableWriter::keys() {
+    return cast_span_to<int64_t>(std::span(m_bytes).subspan(
+        columnar_header_size, m_rows * sizeof(int64_t)));
+}
+
+std::span<double> ColumnarTableWriter::add_reals() {
+    add_kind(columnar_reals);
+    return cast_span_to<double>(grow(m_rows * sizeof(double)));
+}
+
+void ColumnarTableWriter::add_strings(std::span<std::string_view const> v) {
+    Q_ASSERT(v.size() == m_rows);
+
+    add_kind(columnar_strings);
+    write_strings(v, m_rows);
+}
+
+std::span<int32_t>
+ColumnarTableWriter::add_dictionary(std::span<std::string const> entries) {
+    add_kind(columnar_dictionary);
+    add_u64(entries.size());
+
+    std::vector<std::string_view> views(entries.begin(), entries.end());
+
+    write_strings(views, views.size());
+
+    return cast_span_to<int32_t>(grow(m_rows * sizeof(int32_t)));
+}
+
+std::vector<std::byte> ColumnarTableWriter::take() {
+    return std::move(m_bytes);
+}
+
+// =============================================================================
+
+namespace {
+
+constexpr uint32_t row_set_version = 1;
+constexpr uint32_t row_set_array   = 0;
+constexpr uint32_t row_set_bitmap  = 1;
+
+constexpr size_t bitmap_words = 1024;
+
+// an array this full takes as much space as a bitmap
+constexpr size_t array_limit = 4096;
+
+constexpr uint64_t bit_of(uint16_t low) {
+    return uint64_t(1) << (low & 63);
+}
+
+constexpr auto by_high = [](auto const& c, int64_t high) {
+    return c.high < high;
+};
+
+} // namespace
+
+bool RowSet::Container::contains(uint16_t low) const {
+    if (is_bitmap()) return bits[low >> 6] & bit_of(low);
+
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RowSet::Container::add(uint16_t low) {
+    if (is_bitmap()) {
+        auto& word = bits[low >> 6];
+        if (!(word & bit_of(low))) count++;
+        word |= bit_of(low);
+        return;
+    }
+
+    auto iter = std::lower_bound(array.begin(), array.end(), low);
+
+    if (iter != array.end() and *iter == low) return;
+
+    array.insert(iter, low);
+    count++;
+
+    normalize();
+}
+
+void RowSet::Container::add_range(uint32_t first, uint32_t last) {
+    if (first >= last) return;
+
+    // a word at a time
+    to_bitmap();
+
+    while (first < last) {
+        uint32_t const shift = first & 63;
+        uint32_t const n     = std::min(64 - shift, last - first);
+
+        uint64_t const mask = n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+
+        bits[first >> 6] |= mask << shift;
+
+        first += n;
+    }
+
+    recount();
+    normalize();
+}
+
+void RowSet::Container::remove(uint16_t low) {
+    if (is_bitmap()) {
+        auto& word = bits[low >> 6];
+        if (word & bit_of(low)) count--;
+        word &= ~bit_of(low);
+        normalize();
+        return;
+    }
+
+    auto iter = std::lower_bound(array.begin(), array.end(), low);
+
+    if (iter == array.end() or *iter != low) return;
+
+    array.erase(iter);
+    count--;
+}
+
+void RowSet::Container::unite(Container const& o) {
+    if (!is_bitmap() and !o.is_bitmap()) {
+        std::vector<uint16_t> merged;
+        merged.reserve(array.size() + o.array.size());
+
+        std::set_union(array.begin(),
+                       array.end(),
+                       o.array.begin(),
+                       o.array.end(),
+                       std::back_inserter(merged));
+
+        array = std::move(merged);
+        count = array.size();
+
+        normalize();
+        return;
+    }
+
+    to_bitmap();
+
+    if (o.is_bitmap()) {
+        for (size_t w = 0; w < bitmap_words; w++) {
+            bits[w] |= o.bits[w];
+        }
+    } else {
+        for (auto low : o.array) {
+            bits[low >> 6] |= bit_of(low);
+        }
+    }
+
+    recount();
+}
+
+void RowSet::Container::intersect(Container const& o) {
+    if (!is_bitmap()) {
+        std::erase_if(array, [&o](uint16_t low) { return !o.contains(low); });
+        count = array.size();
+        return;
+    }
+
+    if (!o.is_bitmap()) {
+        // no bigger than the other array, so keep it as one
+        std::vector<uint16_t> kept;
+
+        for (auto low : o.array) {
+            if (contains(low)) kept.push_back(low);
+        }
+
+        bits.clear();
+        array = std::move(kept);
+        count = array.size();
+        return;
+    }
+
+    for (size_t w = 0; w < bitmap_words; w++) {
+        bits[w] &= o.bits[w];
+    }
+
+    recount();
+    normalize();
+}
+
+void RowSet::Container::subtract(Container const& o) {
+    if (!is_bitmap()) {
+        std::erase_if(array, [&o](uint16_t low) { return o.contains(low); });
+        count = array.size();
+        return;
+    }
+
+    if (o.is_bitmap()) {
+        for (size_t w = 0; w < bitmap_words; w++) {
+            bits[w] &= ~o.bits[w];
+        }
+    } else {
+        for (auto low : o.array) {
+            bits[low >> 6] &= ~bit_of(low);
+        }
+    }
+
+    recount();
+    normalize();
+}
+
+bool RowSet::Container::same_keys(Container const& o) const {
+    if (high != o.high or count != o.count) return false;
+
+    if (is_bitmap() == o.is_bitmap()) {
+        return is_bitmap() ? bits == o.bits : array == o.array;
+    }
+
+    auto const& a = is_bitmap() ? o : *this;
+    auto const& b = is_bitmap() ? *this : o;
+
+    return std::all_of(a.array.begin(), a.array.end(), [&b](uint16_t low) {
+        return b.contains(low);
+    });
+}
+
+void RowSet::Container::to_bitmap() {
+    if (is_bitmap()) return;
+
+    bits.assign(bitmap_words, 0);
+
+    for (auto low : array) {
+        bits[low >> 6] |= bit_of(low);
+    }
+
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void RowSet::Container::to_array() {
+    if (!is_bitmap()) return;
+
+    array.clear();
+    array.reserve(count);
+
+    for (size_t w = 0; w < bitmap_words; w++) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            array.push_back(uint16_t(w * 64 + std::countr_zero(word)));
+        }
+    }
+
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+void RowSet::Container::recount() {
+    if (!is_bitmap()) {
+        count = array.size();
+        return;
+    }
+
+    count = 0;
+
+    for (auto word : bits) {
+        count += std::popcount(word);
+    }
+}
+
+void RowSet::Container::normalize() {
+    // switch back only well under the limit, so that keys added and removed
+    // around it do not convert back and forth
+    if (is_bitmap() and count <= array_limit / 2) {
+        to_array();
+    } else if (!is_bitmap() and count > array_limit) {
+        to_bitmap();
+    }
+}
+
+// =============
+
+RowSet::RowSet(SelectionRef const& s) {
+    if (!s.row_set.empty()) decode(s.row_set);
+
+    for (auto key : s.rows.span()) {
+        add(key);
+    }
+
+    for (auto const& [first, last] : s.row_ranges) {
+        add_range(first, last);
+    }
+}
+
+RowSet::RowSet(SelectionRef const& s, int64_t first, int64_t last) {
+    if (first >= last) return;
+
+    if (!s.row_set.empty() and decode(s.row_set)) {
+        std::erase_if(m_containers, [first, last](Container const& c) {
+            return c.high < (first >> 16) or c.high > ((last - 1) >> 16);
+        });
+
+        // only the containers at either end can still hold keys outside
+        RowSet outside;
+        outside.add_range((first >> 16) << 16, first);
+        outside.add_range(last, (((last - 1) >> 16) + 1) << 16);
+
+        *this -= outside;
+    }
+
+    for (auto key : s.rows.span()) {
+        if (key >= first and key < last) add(key);
+    }
+
+    // clamped before expanding, so that a wide range cannot make us allocate
+    // without bound
+    for (auto const& [lo, hi] : s.row_ranges) {
+        add_range(std::max(lo, first), std::min(hi, last));
+    }
+}
+
+auto RowSet::container_for(int64_t high) -> Container& {
+    auto iter = std::lower_bound(
+        m_containers.begin(), m_containers.end(), high, by_high);
+
+    if (iter == m_containers.end() or iter->high != high) {
+        iter = m_containers.insert(iter, Container { .high = high });
+    }
+
+    return *iter;
+}
+
+bool RowSet::empty() const {
+    return m_containers.empty();
+}
+
+size_t RowSet::size() const {
+    size_t ret = 0;
+
+    for (auto const& c : m_containers) {
+        ret += c.count;
+    }
+
+    return ret;
+}
+
+bool RowSet::contains(int64_t key) const {
+    auto const high = key >> 16;
+
+    auto iter = std::lower_bound(
+        m_containers.begin(), m_containers.end(), high, by_high);
+
+    if (iter == m_containers.end() or iter->high != high) return false;
+
+    return iter->contains(uint16_t(key & 0xFFFF));
+}
+
+void RowSet::add(int64_t key) {
+    container_for(key >> 16).add(uint16_t(key & 0xFFFF));
+}
+
+void RowSet::add_range(int64_t first, int64_t last) {
+    while (first < last) {
+        int64_t const high = first >> 16;
+        int64_t const base = high << 16;
+        int64_t const end  = std::min(last, base + 0x10000);
+
+        container_for(high).add_range(uint32_t(first - base),
+                                      uint32_t(end - base));
+
+        first = end;
+    }
+}
+
+void RowSet::remove(int64_t key) {
+    auto const high = key >> 16;
+
+    auto iter = std::lower_bound(
+        m_containers.begin(), m_containers.end(), high, by_high);
+
+    if (iter == m_containers.end() or iter->high != high) return;
+
+    iter->remove(uint16_t(key & 0xFFFF));
+
+    if (iter->count == 0) m_containers.erase(iter);
+}
+
+void RowSet::clear() {
+    m_containers.clear();
+}
+
+RowSet& RowSet::operator|=(RowSet const& o) {
+    std::vector<Container> out;
+    out.reserve(m_containers.size() + o.m_containers.size());
+
+    auto a = m_containers.begin();
+    auto b = o.m_containers.begin();
+
+    while (a != m_containers.end() or b != o.m_containers.end()) {
+        if (b == o.m_containers.end() or
+            (a != m_containers.end() and a->high < b->high)) {
+            out.push_back(std::move(*a++));
+        } else if (a == m_containers.end() or b->high < a->high) {
+            out.push_back(*b++);
+        } else {
+            a->unite(*b++);
+            out.push_back(std::move(*a++));
+        }
+    }
+
+    m_containers = std::move(out);
+
+    return *this;
+}
+
+RowSet& RowSet::operator&=(RowSet const& o) {
+    std::vector<Container> out;
+
+    auto b = o.m_containers.begin();
+
+    for (auto& c : m_containers) {
+        while (b != o.m_containers.end() and b->high < c.high) {
+            ++b;
+        }
+
+        if (b == o.m_containers.end()) break;
+        if (b->high != c.high) continue;
+
+        c.intersect(*b);
+
+        if (c.count) out.push_back(std::move(c));
+    }
+
+    m_containers = std::move(out);
+
+    return *this;
+}
+
+RowSet& RowSet::operator-=(RowSet const& o) {
+    auto b = o.m_containers.begin();
+
+    for (auto& c : m_containers) {
+        while (b != o.m_containers.end() and b->high < c.high) {
+            ++b;
+        }
+
+        if (b != o.m_containers.end() and b->high == c.high) c.subtract(*b);
+    }
+
+    std::erase_if(m_containers, [](Container const& c) { return !c.count; });
+
+    return *this;
+}
+
+bool RowSet::operator==(RowSet const& o) const {
+    return std::equal(m_containers.begin(),
+                      m_containers.end(),
+                      o.m_containers.begin(),
+                      o.m_containers.end(),
+                      [](Container const& a, Container const& b) {
+                          return a.same_keys(b);
+                      });
+}
+
+std::vector<int64_t> RowSet::to_vector() const {
+    std::vector<int64_t> ret;
+    ret.reserve(size());
+
+    for_each([&ret](int64_t key) { ret.push_back(key); });
+
+    return ret;
+}
+
+std::vector<std::byte> RowSet::encode() const {
+    std::vector<std::byte> ret;
+
+    auto put = [&ret](void const* p, size_t bytes) {
+        auto const at = ret.size();
+        ret.resize(at + pad_to_8(bytes));
+        std::memcpy(ret.data() + at, p, bytes);
+    };
+
+    {
+        std::array<std::byte, 16> header {};
+
+        uint64_t const count = m_containers.size();
+
+        std::memcpy(header.data(), "NROW", 4);
+        std::memcpy(header.data() + 4, &row_set_version, sizeof(uint32_t));
+        std::memcpy(header.data() + 8, &count, sizeof(count));
+
+        put(header.data(), header.size());
+    }
+
+    for (auto const& c : m_containers) {
+        std::array<std::byte, 16> info {};
+
+        uint32_t const kind  = c.is_bitmap() ? row_set_bitmap : row_set_array;
+        uint32_t const count = c.count;
+
+        std::memcpy(info.data(), &c.high, sizeof(c.high));
+        std::memcpy(info.data() + 8, &kind, sizeof(kind));
+        std::memcpy(info.data() + 12, &count, sizeof(count));
+
+        put(info.data(), info.size());
+
+        if (c.is_bitmap()) {
+            put(c.bits.data(), c.bits.size() * sizeof(uint64_t));
+        } else {
+            put(c.array.data(), c.array.size() * sizeof(uint16_t));
+        }
+    }
+
+    return ret;
+}
+
+bool RowSet::decode(std::span<std::byte const> bytes) {
+    m_containers.clear();
+
+    ColumnarReader reader { bytes };
+
+    auto header = reader.take(16);
+
+    if (!reader.ok or std::memcmp(header.data(), "NROW", 4) != 0) return false;
+
+    uint32_t version;
+    uint64_t num_containers;
+
+    std::memcpy(&version, header.data() + 4, sizeof(version));
+    std::memcpy(&num_containers, header.data() + 8, sizeof(num_containers));
+
+    // every container takes at least 16 bytes
+    if (version != row_set_version or num_containers > bytes.size() / 16) {
+        return false;
+    }
+
+    m_containers.reserve(num_containers);
+
+    for (uint64_t i = 0; i < num_containers; i++) {
+        auto info = reader.take(16);
+        if (!reader.ok) break;
+
+        Container c;
+        uint32_t  kind;
+        uint32_t  count;
+
+        std::memcpy(&c.high, info.data(), sizeof(c.high));
+        std::memcpy(&kind, info.data() + 8, sizeof(kind));
+        std::memcpy(&count, info.data() + 12, sizeof(count));
+
+        bool ok = m_containers.empty() or m_containers.back().high < c.high;
+
+        if (ok and kind == row_set_bitmap) {
+            ok = reader.take_into(c.bits, bitmap_words);
+            c.recount();
+        } else if (ok and kind == row_set_array and count <= array_limit) {
+            ok = reader.take_into(c.array, count) and
+                 std::adjacent_find(c.array.begin(),
+                                    c.array.end(),
+                                    std::greater_equal<>()) == c.array.end();
+            c.count = c.array.size();
+        } else {
+            ok = false;
+        }
+
+        if (!ok or c.count != count or count == 0) {
+            m_containers.clear();
+            return false;
+        }
+
+        c.normalize();
+
+        m_containers.push_back(std::move(c));
+    }
+
+    if (!reader.ok) m_containers.clear();
+
+    return reader.ok;
+}
+
+AnyVar RowSet::to_any() const {
+    AnyVar ret;
+
+    auto& map = ret.emplace<AnyVarMap>();
+
+    map["row_set"].emplace<std::vector<std::byte>>(encode());
+
+    return ret;
+}
+
+RowSet operator|(RowSet a, RowSet const& b) {
+    return a |= b;
+}
+
+RowSet operator&(RowSet a, RowSet const& b) {
+    return a &= b;
+}
+
+RowSet operator-(RowSet a, RowSet const& b) {
+    return a -= b;
+}
+
+// =============================================================================
+
 StringListArg::StringListArg(AnyVarRef const& a) {
     auto l = a.to_vector();
 
@@ -8,8 +8,10 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <bit>
 #include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -44,6 +46,9 @@ struct SelectionRef {
     noo::PossiblyOwnedView<int64_t const> raw_ranges;
     std::span<Pair const>                 row_ranges;
 
+    /// A RowSet in its binary form, if the selection was sent that way
+    std::span<std::byte const> row_set;
+
     SelectionRef() = default;
     SelectionRef(Selection const&);
     SelectionRef(AnyVarRef const&);
@@ -53,6 +58,205 @@ struct SelectionRef {
     Selection to_selection() const;
 };
 
+///
+/// \brief The RowSet class is a compressed set of row keys, in the manner of a
+/// Roaring bitmap.
+///
+/// The high bits of a key pick a container, which holds the low 16 bits. A
+/// container with few keys is a sorted array of them; one with many is a
+/// bitmap of all 65536. Large selections, brushed or ranged, are then a
+/// fraction of the size of a key list, and set operations run a container, or
+/// a bitmap word, at a time.
+///
+/// The binary form is little endian, with each section starting on an 8 byte
+/// boundary:
+/// - the tag "NROW", a u32 version, and a u64 container count
+/// - for each container, in order of high bits, an i64 of the high bits, a u32
+///   kind (0 for arrays, 1 for bitmaps), and a u32 key count, and then
+///   - for arrays, u16[count]
+///   - for bitmaps, u64[1024]
+///
+class RowSet {
+    struct Container {
+        int64_t high = 0;
+
+        // sorted low bits, or, if a bitmap, empty
+        std::vector<uint16_t> array;
+        // empty, unless a bitmap
+        std::vector<uint64_t> bits;
+
+        size_t count = 0;
+
+        bool is_bitmap() const { return !bits.empty(); }
+
+        bool contains(uint16_t) const;
+
+        void add(uint16_t);
+        /// Add [first, last), where last may be 65536
+        void add_range(uint32_t first, uint32_t last);
+        void remove(uint16_t);
+
+        void unite(Container const&);
+        void intersect(Container const&);
+        void subtract(Container const&);
+
+        bool same_keys(Container const&) const;
+
+        void to_bitmap();
+        void to_array();
+        void recount();
+        /// Switch to whichever form suits the key count
+        void normalize();
+
+        template <class Function>
+        void for_each(Function& f) const {
+            int64_t const base = high << 16;
+
+            if (!is_bitmap()) {
+                for (auto low : array) {
+                    f(base | low);
+                }
+                return;
+            }
+
+            for (size_t w = 0; w < bits.size(); w++) {
+                for (uint64_t word = bits[w]; word; word &= word - 1) {
+                    f(base | int64_t(w * 64 + std::countr_zero(word)));
+                }
+            }
+        }
+    };
+
+    // sorted by high bits, and never empty
+    std::vector<Container> m_containers;
+
+    Container& container_for(int64_t high);
+
+public:
+    RowSet() = default;
+
+    /// Collect the rows, ranges, and binary form of a selection. Ranges are
+    /// expanded as given, so untrusted selections should use the bounded
+    /// form below.
+    explicit RowSet(SelectionRef const&);
+
+    /// As above, but only keep keys in [first, last)
+    RowSet(SelectionRef const&, int64_t first, int64_t last);
+
+    bool   empty() const;
+    size_t size() const;
+    bool   contains(int64_t key) const;
+
+    void add(int64_t key);
+    /// Add keys in [first, last)
+    void add_range(int64_t first, int64_t last);
+    void remove(int64_t key);
+    void clear();
+
+    RowSet& operator|=(RowSet const&);
+    RowSet& operator&=(RowSet const&);
+    RowSet& operator-=(RowSet const&);
+
+    bool operator==(RowSet const&) const;
+
+    /// Call f(key) for each key, in order
+    template <class Function>
+    void for_each(Function&& f) const {
+        for (auto const& c : m_containers) {
+            c.for_each(f);
+        }
+    }
+
+    std::vector<int64_t> to_vector() const;
+
+    std::vector<std::byte> encode() const;
+
+    /// Returns false, and leaves this empty, if the bytes are malformed
+    bool decode(std::span<std::byte const>);
+
+    /// As a SelectionObject carrying the binary form
+    AnyVar to_any() const;
+};
+
+RowSet operator|(RowSet, RowSet const&);
+RowSet operator&(RowSet, RowSet const&);
+RowSet operator-(RowSet, RowSet const&);
+
+// =============================================================================
+
+///
+/// \brief The ColumnarTable struct holds a block of table rows decoded from the
+/// binary, column oriented encoding that tables can send in place of lists of
+/// Any values.
+///
+/// The encoding is a single byte array. Everything is little endian, and each
+/// section starts on an 8 byte boundary:
+/// - the tag "NCOL", a u32 version, a u64 row count, and a u64 column count
+/// - the row keys, as i64[rows]
+/// - for each column, a u64 kind (0 for reals, 1 for strings, 2 for
+///   dictionary strings), and then
+///   - for reals, f64[rows]
+///   - for strings, u64 offsets[rows + 1] into the UTF-8 blob that follows,
+///     which is offsets[rows] bytes long
+///   - for dictionary strings, a u64 entry count, the entries laid out as
+///     strings are, and then an i32 code per row, indexing the entries
+///
+struct ColumnarTable {
+    struct Strings {
+        std::vector<uint64_t> offsets;
+        std::string_view      blob;
+
+        size_t           size() const;
+        std::string_view at(size_t row) const;
+    };
+
+    struct Dictionary {
+        Strings              entries;
+        std::vector<int32_t> codes;
+
+        size_t           size() const;
+        std::string_view at(size_t row) const;
+    };
+
+    using Column = std::variant<std::vector<double>, Strings, Dictionary>;
+
+    std::vector<int64_t> keys;
+    std::vector<Column>  columns;
+
+    /// Decode an encoded block. String columns view the given bytes, which
+    /// must outlive this. Returns false if the bytes are malformed.
+    bool decode(std::span<std::byte const>);
+};
+
+///
+/// \brief The ColumnarTableWriter class builds the encoding described in
+/// ColumnarTable. Fill in the keys, then add each column in order.
+///
+class ColumnarTableWriter {
+    std::vector<std::byte> m_bytes;
+    size_t                 m_rows;
+
+    std::span<std::byte> grow(size_t bytes);
+    void                 add_kind(uint64_t);
+    void                 add_u64(uint64_t);
+    void write_strings(std::span<std::string_view const>, size_t count);
+
+public:
+    ColumnarTableWriter(size_t rows, size_t cols);
+
+    /// Spans returned are only valid until the next column is added
+    std::span<int64_t> keys();
+    std::span<double>  add_reals();
+
+    void add_strings(std::span<std::string_view const>);
+
+    /// Add a dictionary string column. Fill the returned span with the code of
+    /// each row.
+    std::span<int32_t> add_dictionary(std::span<std::string const> entries);
+
+    std::vector<std::byte> take();
+};
+
 // =============================================================================
 
 //@{
@@ -1,13 +1,18 @@
 #include "noo_server_interface.h"
 
 #include "include/noo_include_glm.h"
+#include "src/common/column_kernels.h"
+#include "src/common/logging.h"
 #include "src/common/variant_tools.h"
 #include "src/server/noodlesserver.h"
 #include "src/server/noodlesstate.h"
 
 #include <QDebug>
+#include <QMetaMethod>
 
 #include <fstream>
+#include <numeric>
+#include <stdexcept>
 
 #include <glm/gtx/component_wise.hpp>
 
@@ -77,6 +82,10 @@ std::shared_ptr<ServerT> create_server(uint16_t port) {
     return std::make_shared<ServerT>(port);
 }
 
+std::shared_ptr<ServerT> create_server(ServerOptions const& options) {
+    return std::make_shared<ServerT>(options);
+}
+
 // Document ====================================================================
 DocumentTPtr get_document(ServerT* server) {
     return server->state()->document();
@@ -97,7 +106,7 @@ struct is_optional<std::optional<T>> : std::bool_constant<true> { };
 PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
                                          std::vector<std::byte>&  bytes) {
 
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(log_mesh) << Q_FUNC_INFO;
 
     if (refs.triangles.empty() and refs.lines.empty()) return {};
     if (!refs.triangles.empty() and !refs.lines.empty()) return {};
@@ -105,7 +114,7 @@ PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
 
     size_t start_byte = bytes.size();
 
-    qDebug() << "Starting at" << start_byte;
+    qCDebug(log_mesh) << "Starting at" << start_byte;
 
     PackedMeshDataResult ret;
 
@@ -122,9 +131,10 @@ PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
     ret.extent_min = extent_min;
     ret.extent_max = extent_max;
 
-    qDebug() << "Mesh extents" << ret.extent_min.x << ret.extent_min.y
-             << ret.extent_min.z << "|" << ret.extent_max.x << ret.extent_max.y
-             << ret.extent_max.z;
+    qCDebug(log_mesh) << "Mesh extents" << ret.extent_min.x
+                      << ret.extent_min.y << ret.extent_min.z << "|"
+                      << ret.extent_max.x << ret.extent_max.y
+                      << ret.extent_max.z;
 
     // compute cell size
     const size_t cell_byte_size =
@@ -134,20 +144,20 @@ PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
         (refs.colors.empty() ? 0 : sizeof(glm::u8vec4));
 
 
-    qDebug() << "Cell size" << cell_byte_size;
+    qCDebug(log_mesh) << "Cell size" << cell_byte_size;
 
     auto const num_verts =
         std::max(refs.positions.size(),
                  std::max(refs.normals.size(),
                           std::max(refs.textures.size(), refs.colors.size())));
 
-    qDebug() << "Num verts" << num_verts;
+    qCDebug(log_mesh) << "Num verts" << num_verts;
 
 
     {
         size_t const total_vertex_bytes = num_verts * cell_byte_size;
 
-        qDebug() << "New vert byte range" << total_vertex_bytes;
+        qCDebug(log_mesh) << "New vert byte range" << total_vertex_bytes;
         std::vector<std::byte> vertex_portion;
         vertex_portion.resize(total_vertex_bytes);
 
@@ -186,8 +196,8 @@ PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
 
             comp_start += sizeof(T);
 
-            qDebug() << "Add comp" << typeid(T).name() << ref->start
-                     << ref->size << ref->stride;
+            qCDebug(log_mesh) << "Add comp" << typeid(T).name() << ref->start
+                              << ref->size << ref->stride;
         };
 
         add_component(refs.positions, ret.positions);
@@ -207,7 +217,7 @@ PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
     std::span<std::byte const> index_copy_from;
 
     if (!refs.lines.empty()) {
-        qDebug() << "Line segs" << refs.lines.size();
+        qCDebug(log_mesh) << "Line segs" << refs.lines.size();
         index_copy_from = std::as_bytes(refs.lines);
 
         index_ref.size   = index_copy_from.size();
@@ -216,7 +226,7 @@ PackedMeshDataResult pack_mesh_to_vector(BufferMeshDataRef const& refs,
         ret.lines = index_ref;
 
     } else if (!refs.triangles.empty()) {
-        qDebug() << "Triangles" << refs.triangles.size();
+        qCDebug(log_mesh) << "Triangles" << refs.triangles.size();
         index_copy_from = std::as_bytes(refs.triangles);
 
         index_ref.size   = index_copy_from.size();
@@ -305,7 +315,7 @@ void update_light(LightTPtr const& item, LightData const& data) {
 
 MeshData::MeshData(PackedMeshDataResult const& res, BufferTPtr ptr) {
     auto set_from = [&ptr](auto const& src, auto& out) {
-        qDebug() << "HERE";
+        qCDebug(log_mesh) << "HERE";
         if (!src) return;
         auto& l  = *src;
         auto& d  = out.emplace();
@@ -314,7 +324,7 @@ MeshData::MeshData(PackedMeshDataResult const& res, BufferTPtr ptr) {
         d.size   = l.size;
         d.stride = l.stride;
 
-        qDebug() << d.start << d.stride << d.size;
+        qCDebug(log_mesh) << d.start << d.stride << d.size;
     };
 
     extent_min = res.extent_min;
@@ -379,18 +389,100 @@ bool TableQuery::get_cell_to(size_t, size_t, std::string_view&) const {
     return false;
 }
 
+bool TableQuery::get_codes_to(size_t,
+                              std::span<int32_t>,
+                              std::span<std::string const>&) const {
+    return false;
+}
+
 bool TableQuery::get_keys_to(std::span<int64_t>) const {
     return false;
 }
 
 // =============
 
+namespace {
+
+/// Stable removal of flagged rows. Rows past the end of the bitmap are kept.
+template <class T>
+void compact_rows(std::vector<T>&          a,
+                  std::vector<bool> const& doomed,
+                  size_t                   first) {
+    size_t const flagged = std::min(a.size(), doomed.size());
+
+    if (first >= flagged) return;
+
+    size_t write = first;
+
+    for (size_t read = first; read < a.size(); read++) {
+        if (read < flagged and doomed[read]) continue;
+        if (write != read) a[write] = std::move(a[read]);
+        write++;
+    }
+
+    a.erase(a.begin() + write, a.end());
+}
+
+} // namespace
+
+DictionaryStrings::DictionaryStrings(std::span<std::string const> values) {
+    m_codes.reserve(values.size());
+
+    for (auto const& v : values) {
+        push_back(v);
+    }
+}
+
+int32_t DictionaryStrings::find(std::string_view value) const {
+    auto iter = m_lookup.find(std::string(value));
+
+    return iter == m_lookup.end() ? -1 : iter->second;
+}
+
+int32_t DictionaryStrings::intern(std::string_view value) {
+    auto [iter, is_new] =
+        m_lookup.try_emplace(std::string(value), int32_t(m_dictionary.size()));
+
+    if (is_new) m_dictionary.emplace_back(value);
+
+    return iter->second;
+}
+
+void DictionaryStrings::push_back(std::string_view value) {
+    m_codes.push_back(intern(value));
+}
+
+void DictionaryStrings::set(size_t row, std::string_view value) {
+    m_codes[row] = intern(value);
+}
+
+void DictionaryStrings::erase(size_t row) {
+    m_codes.erase(m_codes.begin() + row);
+}
+
+void DictionaryStrings::erase_rows(std::vector<bool> const& doomed,
+                                   size_t                   first) {
+    compact_rows(m_codes, doomed, first);
+}
+
+void DictionaryStrings::clear() {
+    m_codes.clear();
+    m_dictionary.clear();
+    m_lookup.clear();
+}
+
+// =============
+
 size_t TableColumn::size() const {
     return std::visit([&](auto const& a) { return a.size(); }, *this);
 }
 
 bool TableColumn::is_string() const {
-    return std::holds_alternative<std::vector<std::string>>(*this);
+    return !std::holds_alternative<std::vector<double>>(*this);
+}
+
+bool TableColumn::is_dictionary() const {
+    return std::holds_alternative<DictionaryStrings>(*this);
 }
 
 std::span<double const> TableColumn::as_doubles() const {
@@ -398,11 +490,26 @@ std::span<double const> TableColumn::as_doubles() const {
 
     return p ? std::span<double const>(*p) : std::span<double const> {};
 }
-std::span<std::string const> TableColumn::as_string() const {
+StringColumnView TableColumn::as_string() const {
+    if (auto* d = std::get_if<DictionaryStrings>(this)) return *d;
+
     auto* p = std::get_if<std::vector<std::string>>(this);
 
-    return p ? std::span<std::string const>(*p)
-             : std::span<std::string const> {};
+    return p ? StringColumnView(*p) : StringColumnView();
+}
+
+bool TableColumn::encode_as_dictionary() {
+    if (is_dictionary()) return true;
+
+    auto* p = std::get_if<std::vector<std::string>>(this);
+
+    if (!p) return false;
+
+    DictionaryStrings d(*p);
+
+    emplace<DictionaryStrings>(std::move(d));
+
+    return true;
 }
 
 void TableColumn::append(std::span<double const> d) {
@@ -415,6 +522,29 @@ void TableColumn::append(std::span<double const> d) {
             for (auto value : d) {
                 a.push_back(std::to_string(value));
             }
+        },
+        VCASE(DictionaryStrings & a) {
+            for (auto value : d) {
+                a.push_back(std::to_string(value));
+            }
+        });
+}
+
+void TableColumn::append(std::span<int64_t const> d) {
+    VMATCH(
+        *this,
+        VCASE(std::vector<double> & a) {
+            a.insert(a.end(), d.begin(), d.end());
+        },
+        VCASE(std::vector<std::string> & a) {
+            for (auto value : d) {
+                a.push_back(std::to_string(value));
+            }
+        },
+        VCASE(DictionaryStrings & a) {
+            for (auto value : d) {
+                a.push_back(std::to_string(value));
+            }
         });
 }
 
@@ -429,6 +559,10 @@ void TableColumn::append(AnyVarListRef const& d) {
             d.for_each([&](auto, auto const& ref) {
                 a.push_back(std::string(ref.to_string()));
             });
+        },
+        VCASE(DictionaryStrings & a) {
+            d.for_each(
+                [&](auto, auto const& ref) { a.push_back(ref.to_string()); });
         });
 }
 
@@ -438,7 +572,8 @@ void TableColumn::append(double d) {
         VCASE(std::vector<double> & a) { a.push_back(d); },
         VCASE(std::vector<std::string> & a) {
             a.push_back(std::to_string(d));
-        });
+        },
+        VCASE(DictionaryStrings & a) { a.push_back(std::to_string(d)); });
 }
 void TableColumn::append(std::string_view d) {
     VMATCH(
@@ -446,14 +581,16 @@ void TableColumn::append(std::string_view d) {
         VCASE(std::vector<double> & a) {
             a.push_back(std::stod(std::string(d))); // UGH
         },
-        VCASE(std::vector<std::string> & a) { a.push_back(std::string(d)); });
+        VCASE(std::vector<std::string> & a) { a.push_back(std::string(d)); },
+        VCASE(DictionaryStrings & a) { a.push_back(d); });
 }
 
 void TableColumn::set(size_t row, double d) {
     VMATCH(
         *this,
         VCASE(std::vector<double> & a) { a[row] = d; },
-        VCASE(std::vector<std::string> & a) { a[row] = std::to_string(d); });
+        VCASE(std::vector<std::string> & a) { a[row] = std::to_string(d); },
+        VCASE(DictionaryStrings & a) { a.set(row, std::to_string(d)); });
 }
 void TableColumn::set(size_t row, AnyVarRef d) {
     VMATCH(
@@ -461,17 +598,46 @@ void TableColumn::set(size_t row, AnyVarRef d) {
         VCASE(std::vector<double> & a) { a[row] = d.to_real(); },
         VCASE(std::vector<std::string> & a) {
             a[row] = std::string(d.to_string());
-        });
+        },
+        VCASE(DictionaryStrings & a) { a.set(row, d.to_string()); });
 }
 void TableColumn::set(size_t row, std::string_view d) {
     VMATCH(
         *this,
         VCASE(std::vector<double> & a) { a[row] = std::stod(std::string(d)); },
-        VCASE(std::vector<std::string> & a) { a[row] = std::string(d); });
+        VCASE(std::vector<std::string> & a) { a[row] = std::string(d); },
+        VCASE(DictionaryStrings & a) { a.set(row, d); });
+}
+
+void TableColumn::set(std::span<size_t const> rows,
+                      std::span<double const> values) {
+    VMATCH(
+        *this,
+        VCASE(std::vector<double> & a) { column_scatter(values, rows, a); },
+        VCASE(std::vector<std::string> & a) {
+            for (size_t i = 0; i < rows.size(); i++) {
+                a[rows[i]] = std::to_string(values[i]);
+            }
+        },
+        VCASE(DictionaryStrings & a) {
+            for (size_t i = 0; i < rows.size(); i++) {
+                a.set(rows[i], std::to_string(values[i]));
+            }
+        });
 }
 
 void TableColumn::erase(size_t row) {
-    std::visit([row](auto& a) { a.erase(a.begin() + row); }, *this);
+    VMATCH(
+        *this,
+        VCASE(DictionaryStrings & a) { a.erase(row); },
+        VCASE(auto& a) { a.erase(a.begin() + row); });
+}
+
+void TableColumn::erase_rows(std::vector<bool> const& doomed, size_t first) {
+    VMATCH(
+        *this,
+        VCASE(DictionaryStrings & a) { a.erase_rows(doomed, first); },
+        VCASE(auto& a) { compact_rows(a, doomed, first); });
 }
 
 void TableColumn::clear() {
@@ -480,6 +646,59 @@ void TableColumn::clear() {
 
 // =============
 
+std::optional<size_t> KeyIndex::find(int64_t key) const {
+    if (m_keys.empty() or key < m_keys.front() or key > m_keys.back()) {
+        return std::nullopt;
+    }
+
+    auto const size = m_keys.size();
+
+    // keys are distinct and increasing, so each removed row can only pull a
+    // key closer to the front. The row of a key is then at most its distance
+    // from the first key, and at least size - 1 less its distance from the
+    // last.
+    auto const from_front = static_cast<uint64_t>(key - m_keys.front());
+    auto const from_back  = static_cast<uint64_t>(m_keys.back() - key);
+
+    if (from_front + from_back + 1 == size) return from_front;
+
+    auto const lo = from_back < size ? size - 1 - from_back : 0;
+    auto const hi = std::min<uint64_t>(from_front + 1, size);
+
+    auto const end  = m_keys.begin() + hi;
+    auto const iter = std::lower_bound(m_keys.begin() + lo, end, key);
+
+    if (iter == end or *iter != key) return std::nullopt;
+
+    return static_cast<size_t>(std::distance(m_keys.begin(), iter));
+}
+
+size_t KeyIndex::at(int64_t key) const {
+    auto row = find(key);
+    if (!row) throw std::out_of_range("Unknown table key");
+    return *row;
+}
+
+void KeyIndex::append(int64_t first_key, size_t count) {
+    Q_ASSERT(m_keys.empty() or first_key > m_keys.back());
+
+    auto const at = m_keys.size();
+
+    m_keys.resize(at + count);
+
+    std::iota(m_keys.begin() + at, m_keys.end(), first_key);
+}
+
+void KeyIndex::erase_rows(std::vector<bool> const& doomed, size_t first) {
+    compact_rows(m_keys, doomed, first);
+}
+
+void KeyIndex::clear() {
+    m_keys.clear();
+}
+
+// =============
+
 namespace {
 
 
@@ -523,6 +742,19 @@ struct WholeTableQuery : TableQuery {
         } catch (...) { return false; }
     }
 
+    bool get_codes_to(size_t                        col,
+                      std::span<int32_t>            dest,
+                      std::span<std::string const>& dictionary) const override {
+        auto const* d = source->get_columns().at(col).as_string().dictionary();
+
+        if (!d) return false;
+
+        copy_range(d->codes(), dest);
+        dictionary = d->dictionary();
+
+        return true;
+    }
+
     bool get_keys_to(std::span<int64_t> dest) const override {
         auto const& r = source->get_row_to_key_map();
         copy_range(r, dest);
@@ -552,8 +784,8 @@ struct InsertQuery : TableQuery {
 
         auto sp = column.as_doubles();
 
-        qDebug() << Q_FUNC_INFO << col << dest.size() << start_at << num_rows
-                 << sp.size();
+        qCDebug(log_table) << Q_FUNC_INFO << col << dest.size() << start_at
+                           << num_rows << sp.size();
 
         sp = noo::safe_subspan(sp, start_at, num_rows);
 
@@ -580,6 +812,19 @@ struct InsertQuery : TableQuery {
         } catch (...) { return false; }
     }
 
+    bool get_codes_to(size_t                        col,
+                      std::span<int32_t>            dest,
+                      std::span<std::string const>& dictionary) const override {
+        auto const* d = source->get_columns().at(col).as_string().dictionary();
+
+        if (!d) return false;
+
+        copy_range(noo::safe_subspan(d->codes(), start_at, num_rows), dest);
+        dictionary = d->dictionary();
+
+        return true;
+    }
+
     bool get_keys_to(std::span<int64_t> dest) const override {
         auto const& r = source->get_row_to_key_map();
 
@@ -614,11 +859,11 @@ struct UpdateQuery : TableQuery {
 
         auto sp = column.as_doubles();
 
-        auto& map = source->get_key_to_row_map();
+        auto& index = source->get_key_index();
 
         for (size_t i = 0; i < num_rows; i++) {
             auto key = keys[i];
-            auto row = map.at(key);
+            auto row = index.at(key);
 
             dest[i] = sp[row];
         }
@@ -635,10 +880,10 @@ struct UpdateQuery : TableQuery {
 
             if (row >= sp.size()) return false;
 
-            auto& map = source->get_key_to_row_map();
+            auto& index = source->get_key_index();
 
             auto key        = keys[row];
-            auto source_row = map.at(key);
+            auto source_row = index.at(key);
 
             s = sp[source_row];
 
@@ -650,6 +895,25 @@ struct UpdateQuery : TableQuery {
         }
     }
 
+    bool get_codes_to(size_t                        col,
+                      std::span<int32_t>            dest,
+                      std::span<std::string const>& dictionary) const override {
+        auto const* d = source->get_columns().at(col).as_string().dictionary();
+
+        if (!d) return false;
+
+        auto const codes = d->codes();
+        auto&      index = source->get_key_index();
+
+        for (size_t i = 0; i < num_rows and i < dest.size(); i++) {
+            dest[i] = codes[index.at(keys[i])];
+        }
+
+        dictionary = d->dictionary();
+
+        return true;
+    }
+
     bool get_keys_to(std::span<int64_t> dest) const override {
         copy(keys.begin(), keys.end(), dest.begin(), dest.end());
         return true;
@@ -682,65 +946,71 @@ struct DeleteQuery : TableQuery {
     }
 
     bool get_keys_to(std::span<int64_t> dest) const override {
-        qDebug() << Q_FUNC_INFO << dest.size() << keys.size();
+        qCDebug(log_table) << Q_FUNC_INFO << dest.size() << keys.size();
         copy(keys.begin(), keys.end(), dest.begin(), dest.end());
         return true;
     }
 };
 
-} // namespace
-
-TableQueryPtr TableSource::handle_insert(AnyVarListRef const& cols) {
-    // get dimensions of insert
-
-    size_t num_cols = cols.size();
-
-    if (num_cols == 0) return nullptr;
-    if (num_cols != m_columns.size()) return nullptr;
-
+/// Rows in a set of incoming columns, or zero if a column has the wrong type
+size_t incoming_row_count(std::vector<TableColumn> const& columns,
+                          AnyVarListRef const&            cols) {
     size_t num_rows = 0;
-    bool   ok       = true;
 
-    for (size_t ci = 0; ci < num_cols; ci++) {
+    for (size_t ci = 0; ci < cols.size(); ci++) {
         auto r = cols[ci];
         switch (r.type()) {
         case AnyVarRef::AnyType::RealList:
-            if (m_columns.at(ci).is_string()) ok = false;
+            if (columns.at(ci).is_string()) return 0;
             num_rows = std::max(num_rows, r.to_real_list().size());
             break;
+        case AnyVarRef::AnyType::IntegerList:
+            if (columns.at(ci).is_string()) return 0;
+            num_rows = std::max(num_rows, r.to_int_list().size());
+            break;
         case AnyVarRef::AnyType::AnyList:
             num_rows = std::max(num_rows, r.to_vector().size());
             break;
-        default: ok = false; break;
+        default: return 0;
         }
     }
 
-    if (!ok or num_rows == 0) return nullptr;
+    return num_rows;
+}
 
-    qDebug() << Q_FUNC_INFO << "num rows" << num_rows;
+} // namespace
 
-    // lets get some keys
+TableQueryPtr TableSource::handle_insert(AnyVarListRef const& cols) {
+    // get dimensions of insert
+
+    size_t const num_cols = cols.size();
 
-    std::vector<int64_t> new_row_keys;
-    new_row_keys.resize(num_rows);
+    if (num_cols == 0) return nullptr;
+    if (num_cols != m_columns.size()) return nullptr;
+
+    size_t const num_rows = incoming_row_count(m_columns, cols);
+
+    if (num_rows == 0) return nullptr;
+
+    qCDebug(log_table) << Q_FUNC_INFO << "num rows" << num_rows;
+
+    // lets get some keys. They are handed out in order, so the new rows just
+    // extend the index
 
     auto const current_row_count = m_columns.at(0).size();
 
-    qDebug() << "current row count" << current_row_count;
+    qCDebug(log_table) << "current row count" << current_row_count;
 
-    for (size_t i = 0; i < num_rows; i++) {
-        new_row_keys[i]             = m_counter;
-        m_key_to_row_map[m_counter] = current_row_count + i;
-        m_counter++;
-    }
+    auto const first_key = static_cast<int64_t>(m_counter);
 
-    m_row_to_key_map.insert(
-        m_row_to_key_map.end(), new_row_keys.begin(), new_row_keys.end());
+    m_keys.append(first_key, num_rows);
+    m_counter += num_rows;
 
-    qDebug() << "assigned keys"
-             << QVector<int64_t>::fromStdVector(new_row_keys);
+    qCDebug(log_table) << "assigned keys" << first_key << "to"
+                       << first_key + int64_t(num_rows) - 1;
 
-    // now lets insert
+    // now lets insert. Typed lists are copied straight out of the message, in
+    // one go; only lists of Any values are read a cell at a time
 
     for (size_t ci = 0; ci < num_cols; ci++) {
         auto  source_col = cols[ci];
@@ -748,20 +1018,24 @@ TableQueryPtr TableSource::handle_insert(AnyVarListRef const& cols) {
         VMATCH_W(
             visit,
             source_col,
-            VCASE(std::span<double> data) { dest_col.append(data); },
+            VCASE(std::span<double const> data) { dest_col.append(data); },
+            VCASE(std::span<int64_t const> data) { dest_col.append(data); },
             VCASE(AnyVarListRef const& ref) { dest_col.append(ref); },
             VCASE(auto const&) {
                 // do nothing, should not get here
                 qFatal("Unable to insert this data type");
             })
 
+        // building these copies is only worth it if someone is looking
+        if (!NOO_DEBUG_ENABLED(log_table)) continue;
+
         if (dest_col.is_string()) {
             QVector<QString> sl;
 
             for (auto const& s : dest_col.as_string()) {
                 sl.push_back(noo::to_qstring(s));
             }
-            qDebug() << "Col " << ci << "is now" << sl;
+            qCDebug(log_table) << "Col " << ci << "is now" << sl;
 
         } else {
             QVector<double> sl;
@@ -769,7 +1043,7 @@ TableQueryPtr TableSource::handle_insert(AnyVarListRef const& cols) {
             for (auto const& s : dest_col.as_doubles()) {
                 sl.push_back(s);
             }
-            qDebug() << "Col " << ci << "is now" << sl;
+            qCDebug(log_table) << "Col " << ci << "is now" << sl;
         }
     }
 
@@ -787,124 +1061,179 @@ TableQueryPtr TableSource::handle_update(AnyVarRef const&     keys,
     if (num_cols == 0) return nullptr;
     if (num_cols != m_columns.size()) return nullptr;
 
-    size_t num_rows = 0;
-    bool   ok       = true;
+    size_t const num_rows = incoming_row_count(m_columns, cols);
 
-    for (size_t ci = 0; ci < num_cols; ci++) {
-        auto r = cols[ci];
-        switch (r.type()) {
-        case AnyVarRef::AnyType::RealList:
-            if (m_columns.at(ci).is_string()) ok = false;
-            num_rows = std::max(num_rows, r.to_real_list().size());
-            break;
-        case AnyVarRef::AnyType::AnyList:
-            num_rows = std::max(num_rows, r.to_vector().size());
-            break;
-        default: ok = false; break;
-        }
-    }
+    if (num_rows == 0) return nullptr;
 
-    if (!ok or num_rows == 0) return nullptr;
-
-    qDebug() << Q_FUNC_INFO << num_rows;
+    qCDebug(log_table) << Q_FUNC_INFO << num_rows;
 
     // lets get some keys
 
     auto key_list      = keys.coerce_int_list();
     auto key_list_span = key_list.span();
 
-    // now lets update
+    // find the rows first, so that each column can then be written in one
+    // pass, rather than a cell at a time
+
+    std::vector<size_t> update_rows; // where in the table
+    std::vector<size_t> source_rows; // where in the incoming columns
 
     for (size_t key_i = 0; key_i < key_list.size(); key_i++) {
         auto key = key_list_span[key_i];
 
-        auto iter = m_key_to_row_map.find(key);
-
-        if (iter == m_key_to_row_map.end()) continue;
-
-        auto const update_at = iter->second;
-
-        for (size_t ci = 0; ci < num_cols; ci++) {
-            auto  source_col = cols[ci];
-            auto& dest_col   = m_columns.at(ci);
-            VMATCH_W(
-                visit,
-                source_col,
-                VCASE(std::span<double> data) {
-                    dest_col.set(update_at, data[key_i]);
-                },
-                VCASE(AnyVarListRef const& ref) {
-                    dest_col.set(update_at, ref[key_i]);
-                },
-                VCASE(auto const&) {
-                    // do nothing, should not get here
-                    qFatal("Unable to insert this data type");
-                })
-        }
+        auto row = m_keys.find(key);
+
+        if (!row or !is_row_live(*row)) continue;
+
+        update_rows.push_back(*row);
+        source_rows.push_back(key_i);
     }
 
-    // now return a query to the data
+    if (update_rows.empty()) return nullptr;
+
+    // now lets update
+
+    // a short column only updates the rows it reaches
+    auto reach_of = [&source_rows](size_t column_size) -> size_t {
+        return std::lower_bound(
+                   source_rows.begin(), source_rows.end(), column_size) -
+               source_rows.begin();
+    };
 
-    return std::make_shared<UpdateQuery>(this, span_to_vector(key_list.span()));
+    std::vector<double> gathered;
+
+    for (size_t ci = 0; ci < num_cols; ci++) {
+        auto  source_col = cols[ci];
+        auto& dest_col   = m_columns.at(ci);
+        VMATCH_W(
+            visit,
+            source_col,
+            VCASE(std::span<double const> data) {
+                auto const reach = reach_of(data.size());
+
+                gathered.resize(reach);
+                column_gather(
+                    data, std::span(source_rows).first(reach), gathered);
+                dest_col.set(std::span(update_rows).first(reach), gathered);
+            },
+            VCASE(std::span<int64_t const> data) {
+                auto const reach = reach_of(data.size());
+
+                gathered.resize(reach);
+                for (size_t i = 0; i < reach; i++) {
+                    gathered[i] = double(data[source_rows[i]]);
+                }
+                dest_col.set(std::span(update_rows).first(reach), gathered);
+            },
+            VCASE(AnyVarListRef const& ref) {
+                for (size_t i = 0; i < update_rows.size(); i++) {
+                    dest_col.set(update_rows[i], ref[source_rows[i]]);
+                }
+            },
+            VCASE(auto const&) {
+                // do nothing, should not get here
+                qFatal("Unable to insert this data type");
+            })
+    }
+
+    // now return a query to the data, for only the keys that were found.
+    // Unknown and deleted keys would otherwise be sent out as updates.
+
+    std::vector<int64_t> updated_keys;
+    updated_keys.reserve(source_rows.size());
+
+    for (auto key_i : source_rows) {
+        updated_keys.push_back(key_list_span[key_i]);
+    }
+
+    return std::make_shared<UpdateQuery>(this, std::move(updated_keys));
 }
 
 TableQueryPtr TableSource::handle_deletion(AnyVarRef const& keys) {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(log_table) << Q_FUNC_INFO;
     auto key_list = keys.coerce_int_list();
 
-    qDebug() << QVector<int64_t>(key_list.begin(), key_list.end());
+    qCDebug(log_table) << QVector<int64_t>(key_list.begin(), key_list.end());
+
+    // to delete we mark the rows to remove, and then sweep them out of every
+    // column in one pass, rather than erasing them one at a time
 
-    // to delete we are finding the rows to remove, and then deleting the rows
-    // from highest to lowest. this means we dont break index validity
+    auto const row_count = m_keys.size();
 
-    std::vector<size_t> rows_to_delete;
+    m_tombstones.resize(row_count, false);
+
+    // only the keys removed here are reported to subscribers
+    std::vector<int64_t> deleted_keys;
+    deleted_keys.reserve(key_list.size());
 
     for (auto k : key_list) {
-        if (m_key_to_row_map.count(k) != 1) continue;
+        auto row = m_keys.find(k);
 
-        rows_to_delete.push_back(m_key_to_row_map.at(k));
+        // keys stay in the index until compaction, so skip those already
+        // marked
+        if (!row or m_tombstones[*row]) continue;
 
-        m_key_to_row_map.erase(k);
+        m_tombstones[*row] = true;
+        deleted_keys.push_back(k);
     }
 
-    qDebug() << "Rows to delete"
-             << QVector<size_t>(rows_to_delete.begin(), rows_to_delete.end());
-
-    std::sort(
-        rows_to_delete.begin(), rows_to_delete.end(), std::greater<size_t>());
+    auto const marked = deleted_keys.size();
 
-    qDebug() << "Rows to delete sorted"
-             << QVector<size_t>(rows_to_delete.begin(), rows_to_delete.end());
+    // deleting rows that are already gone is not an error, but there is
+    // nothing to tell subscribers
+    if (marked == 0) return std::make_shared<DeleteQuery>(this, deleted_keys);
 
-    for (auto row : rows_to_delete) {
-        m_row_to_key_map.erase(m_row_to_key_map.begin() + row);
-        for (auto& c : m_columns) {
-            c.erase(row);
-        }
-    }
+    m_tombstone_count += marked;
 
-    qDebug() << "Rebuilding maps";
+    qCDebug(log_table) << "Rows marked" << marked << "pending"
+                       << m_tombstone_count;
 
-    for (size_t row = 0; row < m_row_to_key_map.size(); row++) {
-        auto k              = m_row_to_key_map[row];
-        m_key_to_row_map[k] = row;
-    }
+    if (!m_lazy_deletion or m_tombstone_count * 4 >= row_count) compact();
 
 
-    return std::make_shared<DeleteQuery>(this, span_to_vector(key_list.span()));
+    return std::make_shared<DeleteQuery>(this, std::move(deleted_keys));
 }
 
 bool TableSource::handle_reset() {
     for (auto& col : m_columns) {
         col.clear();
     }
+    m_keys.clear();
+    m_tombstones.clear();
+    m_tombstone_count = 0;
     return true;
 }
 
 bool TableSource::handle_set_selection(std::string_view    s,
                                        SelectionRef const& ref) {
+    auto name = std::string(s);
+
+    // selections are limited to the keys the table has
+    auto const& keys = m_keys.keys();
+
+    RowSet next = keys.empty() ? RowSet()
+                               : RowSet(ref, keys.front(), keys.back() + 1);
+
+    auto& current = m_selections[name];
+
+    auto added   = next - current;
+    auto removed = current - next;
+
+    current = std::move(next);
+
+    if (added.empty() and removed.empty()) return true;
+
+    static auto const whole_signal =
+        QMetaMethod::fromSignal(&TableSource::table_selection_updated);
+
+    if (isSignalConnected(whole_signal)) {
+        SelectionRef whole;
+        whole.rows = current.to_vector();
 
-    m_selections[std::string(s)] = ref.to_selection();
+        emit table_selection_updated(name, whole);
+    }
+
+    emit table_selection_changed(std::move(name), added, removed);
 
     return true;
 }
@@ -922,9 +1251,50 @@ std::vector<std::string> TableSource::get_headers() {
 
 
 TableQueryPtr TableSource::get_all_data() {
+    compact();
     return std::make_shared<WholeTableQuery>(this);
 }
 
+TableQueryPtr TableSource::get_row_range(size_t first, size_t count) {
+    compact();
+
+    auto const row_count = m_keys.size();
+
+    first = std::min(first, row_count);
+    count = std::min(count, row_count - first);
+
+    return std::make_shared<InsertQuery>(this, first, count);
+}
+
+void TableSource::set_lazy_deletion(bool lazy) {
+    m_lazy_deletion = lazy;
+    if (!m_lazy_deletion) compact();
+}
+
+bool TableSource::is_row_live(size_t row) const {
+    return row >= m_tombstones.size() or !m_tombstones[row];
+}
+
+void TableSource::compact() {
+    if (m_tombstone_count == 0) return;
+
+    auto const first = static_cast<size_t>(std::distance(
+        m_tombstones.begin(),
+        std::find(m_tombstones.begin(), m_tombstones.end(), true)));
+
+    qCDebug(log_table) << "Compacting" << m_tombstone_count << "rows from"
+                       << first;
+
+    for (auto& c : m_columns) {
+        c.erase_rows(m_tombstones, first);
+    }
+
+    m_keys.erase_rows(m_tombstones, first);
+
+    m_tombstones.clear();
+    m_tombstone_count = 0;
+}
+
 
 bool TableSource::ask_insert(AnyVarListRef const& cols) {
     auto b = handle_insert(cols);
@@ -947,7 +1317,7 @@ bool TableSource::ask_update(AnyVarRef const&     keys,
 bool TableSource::ask_delete(AnyVarRef const& keys) {
     auto b = handle_deletion(keys);
 
-    if (b) { emit table_row_deleted(b); }
+    if (b and b->num_rows) { emit table_row_deleted(b); }
 
     return !!b;
 }
@@ -977,6 +1347,34 @@ void update_object(ObjectTPtr item, ObjectUpdateData& data) {
     item->update(data);
 }
 
+std::vector<ObjectTPtr> create_objects(DocumentTPtrRef             doc,
+                                       std::span<ObjectData const> data) {
+    return doc->obj_list().provision_many(data);
+}
+
+void update_objects(std::span<ObjectTPtr const> objects,
+                    std::span<ObjectUpdateData> data) {
+    Q_ASSERT(objects.size() == data.size());
+
+    auto const count = std::min(objects.size(), data.size());
+
+    for (size_t i = 0; i < count; i++) {
+        if (objects[i]) objects[i]->update(data[i]);
+    }
+}
+
+void update_object_transforms(std::span<ObjectTPtr const> objects,
+                              std::span<glm::mat4 const>  transforms) {
+    Q_ASSERT(objects.size() == transforms.size());
+
+    auto const count = std::min(objects.size(), transforms.size());
+
+    // these all end up in the same broadcast frame
+    for (size_t i = 0; i < count; i++) {
+        if (objects[i]) objects[i]->update_transform(transforms[i]);
+    }
+}
+
 void                     ObjectCallbacks::on_activate_str(std::string) { }
 void                     ObjectCallbacks::on_activate_int(int) { }
 std::vector<std::string> ObjectCallbacks::get_activation_choices() {
@@ -8,8 +8,11 @@
 #include <QObject>
 #include <QUrl>
 
+#include <compare>
+#include <cstddef>
 #include <filesystem>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <span>
@@ -237,9 +240,55 @@ SignalTPtr create_signal(DocumentT*, SignalData const&);
 
 // Server ======================================================================
 
+///
+/// \brief The ServerOptions struct is used to configure a new server.
+///
+struct ServerOptions {
+    /// Port to listen on
+    uint16_t port = 50000;
+
+    /// Outgoing messages are packed into frames. A frame that grows past this
+    /// many bytes is sent right away, and further messages go into a new one.
+    size_t max_frame_size = 1 << 20;
+
+    /// Bytes a client may have handed to its socket, but not yet written out.
+    /// Further frames are held in a queue for that client.
+    size_t client_send_window = 4 << 20;
+
+    /// Once this many bytes are held for a client, superseded object, light,
+    /// and material updates are dropped from its queue.
+    size_t client_conflate_threshold = 16 << 20;
+
+    /// A client that still has more than this many bytes held after
+    /// conflation is disconnected. Zero disables the limit.
+    size_t client_queue_limit = 256 << 20;
+
+    /// Number of threads to run client sockets on. With zero, sockets are
+    /// handled on the thread that owns the server.
+    unsigned io_threads = 0;
+
+    /// Number of threads to verify incoming messages on. With zero, messages
+    /// are verified on the thread that received them.
+    unsigned verify_threads = 0;
+
+    /// Transform updates made through update_object_transforms that move no
+    /// matrix element by more than this, compared to what was last sent, are
+    /// held back until they do. Zero sends every change.
+    float transform_deadband = 0;
+
+    /// A transform held back by the deadband is sent anyway once its object
+    /// has not moved for this many milliseconds, or with the next update to
+    /// that object, whichever comes first. Held objects are checked at this
+    /// interval, so a send may take up to twice as long.
+    unsigned transform_settle_ms = 100;
+};
+
 /// Create a new server, which uses a WebSocket to listen on the given port.
 std::shared_ptr<ServerT> create_server(uint16_t port);
 
+/// Create a new server with the given options.
+std::shared_ptr<ServerT> create_server(ServerOptions const&);
+
 // Document ====================================================================
 
 /// Get the document of a server.
@@ -467,14 +516,162 @@ struct TableQuery {
     virtual bool get_reals_to(size_t col, std::span<double>) const;
     virtual bool get_cell_to(size_t col, size_t row, std::string_view&) const;
 
+    /// For dictionary encoded string columns, copy out the code of each row,
+    /// and point to the dictionary the codes index. Returns false for other
+    /// columns.
+    virtual bool get_codes_to(size_t                        col,
+                              std::span<int32_t>            codes,
+                              std::span<std::string const>& dictionary) const;
+
     virtual bool get_keys_to(std::span<int64_t>) const;
 };
 
 using TableQueryPtr = std::shared_ptr<TableQuery const>;
 
+///
+/// \brief The DictionaryStrings class stores a string column as a code for each
+/// row, indexing a pool of the distinct values. This suits categorical columns,
+/// with few distinct values over many rows.
+///
+/// Values are not removed from the pool when rows stop using them.
+///
+class DictionaryStrings {
+    std::vector<int32_t>                     m_codes;
+    std::vector<std::string>                 m_dictionary;
+    std::unordered_map<std::string, int32_t> m_lookup;
+
+public:
+    DictionaryStrings() = default;
+    explicit DictionaryStrings(std::span<std::string const>);
+
+    size_t size() const { return m_codes.size(); }
+
+    std::string_view operator[](size_t row) const {
+        return m_dictionary[m_codes[row]];
+    }
+
+    std::span<int32_t const>     codes() const { return m_codes; }
+    std::span<std::string const> dictionary() const { return m_dictionary; }
+
+    /// Code of a value, or -1 if no row has ever held it
+    int32_t find(std::string_view) const;
+
+    /// Code of a value, adding it to the dictionary if needed
+    int32_t intern(std::string_view);
+
+    void push_back(std::string_view);
+    void set(size_t row, std::string_view);
+
+    void erase(size_t row);
+    void erase_rows(std::vector<bool> const& doomed, size_t first);
+
+    void clear();
+};
+
+///
+/// \brief The StringColumnView class reads the cells of a string column,
+/// however the column is stored.
+///
+/// API change: TableColumn::as_string() used to return a
+/// std::span<std::string const>. This view indexes, iterates, and works with
+/// std algorithms and ranges as before, but cells are std::string_views, and
+/// there is no data(). Use plain() for the span of an unencoded column.
+///
+class StringColumnView {
+    std::span<std::string const> m_plain;
+    DictionaryStrings const*     m_dictionary = nullptr;
+
+public:
+    StringColumnView() = default;
+    StringColumnView(std::span<std::string const> s) : m_plain(s) { }
+    StringColumnView(DictionaryStrings const& d) : m_dictionary(&d) { }
+
+    size_t size() const {
+        return m_dictionary ? m_dictionary->size() : m_plain.size();
+    }
+    bool empty() const { return size() == 0; }
+
+    std::string_view operator[](size_t row) const {
+        if (m_dictionary) return (*m_dictionary)[row];
+        return m_plain[row];
+    }
+
+    /// Null if the column is not dictionary encoded
+    DictionaryStrings const* dictionary() const { return m_dictionary; }
+
+    /// The cells of a column that is not dictionary encoded; empty otherwise
+    std::span<std::string const> plain() const { return m_plain; }
+
+    /// Cells are made on access, so this is an input iterator to the legacy
+    /// iterator requirements, and random access to the C++20 concepts.
+    struct iterator {
+        using iterator_category = std::input_iterator_tag;
+        using iterator_concept  = std::random_access_iterator_tag;
+        using value_type        = std::string_view;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = std::string_view;
+        using pointer           = void;
+
+        StringColumnView const* view = nullptr;
+        size_t                  row  = 0;
+
+        std::string_view operator*() const { return (*view)[row]; }
+        std::string_view operator[](difference_type n) const {
+            return (*view)[row + n];
+        }
+
+        iterator& operator++() {
+            row++;
+            return *this;
+        }
+        iterator operator++(int) {
+            auto ret = *this;
+            row++;
+            return ret;
+        }
+        iterator& operator--() {
+            row--;
+            return *this;
+        }
+        iterator operator--(int) {
+            auto ret = *this;
+            row--;
+            return ret;
+        }
+
+        iterator& operator+=(difference_type n) {
+            row += n;
+            return *this;
+        }
+        iterator& operator-=(difference_type n) {
+            row -= n;
+            return *this;
+        }
+
+        friend iterator operator+(iterator i, difference_type n) {
+            return i += n;
+        }
+        friend iterator operator+(difference_type n, iterator i) {
+            return i += n;
+        }
+        friend iterator operator-(iterator i, difference_type n) {
+            return i -= n;
+        }
+        friend difference_type operator-(iterator const& a, iterator const& b) {
+            return difference_type(a.row) - difference_type(b.row);
+        }
+
+        bool operator==(iterator const& o) const { return row == o.row; }
+        auto operator<=>(iterator const& o) const { return row <=> o.row; }
+    };
+
+    iterator begin() const { return { this, 0 }; }
+    iterator end() const { return { this, size() }; }
+};
 
-class TableColumn
-    : public std::variant<std::vector<double>, std::vector<std::string>> {
+class TableColumn : public std::variant<std::vector<double>,
+                                        std::vector<std::string>,
+                                        DictionaryStrings> {
 public:
     std::string name;
 
@@ -482,11 +679,17 @@ public:
 
     size_t size() const;
     bool   is_string() const;
+    bool   is_dictionary() const;
+
+    std::span<double const> as_doubles() const;
+    StringColumnView        as_string() const;
 
-    std::span<double const>      as_doubles() const;
-    std::span<std::string const> as_string() const;
+    /// Switch a string column to dictionary encoding. Returns false if this is
+    /// not a string column.
+    bool encode_as_dictionary();
 
     void append(std::span<double const>);
+    void append(std::span<int64_t const>);
     void append(AnyVarListRef const&);
     void append(double);
     void append(std::string_view);
@@ -495,8 +698,48 @@ public:
     void set(size_t row, AnyVarRef);
     void set(size_t row, std::string_view);
 
+    /// Write values to the given rows, which must all be in range
+    void set(std::span<size_t const> rows, std::span<double const> values);
+
     void erase(size_t row);
 
+    /// Remove every row flagged in the bitmap, keeping the rest in order, in
+    /// a single pass. No row before \p first may be flagged.
+    void erase_rows(std::vector<bool> const& doomed, size_t first = 0);
+
+    void clear();
+};
+
+///
+/// \brief The KeyIndex class maps between rows and keys of a table.
+///
+/// Keys are handed out in increasing order and rows are only ever removed in
+/// place, so the keys of a table are always sorted by row. That list is the
+/// whole index: a key is found by its offset from the first key while no
+/// rows have been removed, and by a binary search bounded by that offset
+/// afterwards.
+///
+class KeyIndex {
+    std::vector<int64_t> m_keys;
+
+public:
+    /// The key of each row
+    std::vector<int64_t> const& keys() const { return m_keys; }
+    size_t                      size() const { return m_keys.size(); }
+
+    std::optional<size_t> find(int64_t key) const;
+
+    /// As find(), but throws std::out_of_range for a missing key
+    size_t at(int64_t key) const;
+
+    /// Add rows for count keys, starting at first_key, which must be past
+    /// every key already held
+    void append(int64_t first_key, size_t count);
+
+    /// Remove the keys of every row flagged in the bitmap. No row before
+    /// \p first may be flagged.
+    void erase_rows(std::vector<bool> const& doomed, size_t first = 0);
+
     void clear();
 };
 
@@ -510,12 +753,15 @@ class TableSource : public QObject {
 protected:
     std::vector<TableColumn> m_columns;
     uint64_t                 m_counter = 0;
+    KeyIndex                 m_keys;
 
-    std::unordered_map<int64_t, uint64_t> m_key_to_row_map;
-    std::vector<int64_t>                  m_row_to_key_map;
+    // rows that have been deleted but not yet compacted away
+    std::vector<bool> m_tombstones;
+    size_t            m_tombstone_count = 0;
+    bool              m_lazy_deletion   = false;
 
     // how should selections handle key deletion?
-    std::unordered_map<std::string, Selection> m_selections;
+    std::unordered_map<std::string, RowSet> m_selections;
 
 protected:
     virtual TableQueryPtr handle_insert(AnyVarListRef const& cols);
@@ -532,11 +778,27 @@ public:
     std::vector<std::string> get_headers();
     TableQueryPtr            get_all_data();
 
+    /// Fetch up to count rows, starting at the given row
+    TableQueryPtr get_row_range(size_t first, size_t count);
+
     auto const& get_columns() const { return m_columns; }
     auto const& get_all_selections() const { return m_selections; }
-    auto const& get_key_to_row_map() const { return m_key_to_row_map; }
-    auto const& get_row_to_key_map() const { return m_row_to_key_map; }
 
+    /// Replaces get_key_to_row_map(), and the hash map it returned; use
+    /// KeyIndex::find() to look up the row of a key. Keys of rows deleted
+    /// lazily stay in the index until compaction; see is_row_live().
+    auto const& get_key_index() const { return m_keys; }
+    auto const& get_row_to_key_map() const { return m_keys.keys(); }
+
+    /// In lazy deletion mode, deleted rows are only marked, and are swept out
+    /// once they make up a quarter of the table, or when all data is fetched.
+    /// Until then, the columns and the row to key map still hold them; use
+    /// is_row_live() to skip them.
+    void set_lazy_deletion(bool);
+    bool is_row_live(size_t row) const;
+
+    /// Sweep out all deleted rows now
+    void compact();
 
     bool ask_insert(AnyVarListRef const&); // list of lists
     bool ask_update(AnyVarRef const& keys,
@@ -547,6 +809,14 @@ public:
 
 signals:
     void table_reset();
+
+    /// A selection has changed. Only the keys that changed are given.
+    void table_selection_changed(std::string,
+                                 RowSet const& added,
+                                 RowSet const& removed);
+
+    /// As above, with the whole selection as a list of rows. Kept for
+    /// existing receivers; it is only built if something is connected.
     void table_selection_updated(std::string, SelectionRef const&);
     void table_row_updated(TableQueryPtr);
     void table_row_deleted(TableQueryPtr);
@@ -658,6 +928,19 @@ void             update_object(ObjectT*, ObjectUpdateData&);
 void             update_object(ObjectTPtr, ObjectUpdateData&);
 ObjectCallbacks* get_callbacks_from(ObjectT*);
 
+/// Create many objects at once. Parents must already exist.
+std::vector<ObjectTPtr> create_objects(DocumentTPtrRef,
+                                       std::span<ObjectData const>);
+
+/// Update many objects at once; each object gets the update at the same
+/// position.
+void update_objects(std::span<ObjectTPtr const>, std::span<ObjectUpdateData>);
+
+/// Move many objects at once; each object gets the transform at the same
+/// position. See ServerOptions::transform_deadband.
+void update_object_transforms(std::span<ObjectTPtr const>,
+                              std::span<glm::mat4 const>);
+
 void issue_signal_direct(ObjectT*, SignalT*, AnyVarList);
 void issue_signal_direct(ObjectT*, std::string const&, AnyVarList);
 
@@ -10,6 +10,22 @@ void SubscribeInitReply::interpret() {
 
     auto arg_map = m_var.to_map();
 
+    if (arg_map.count("columnar")) {
+        noo::ColumnarTable table;
+
+        if (!table.decode(arg_map["columnar"].to_data())) {
+            qDebug() << "Malformed columnar subscribe reply";
+            emit recv_fail("Bad subscription reply!");
+            return;
+        }
+
+        auto names = arg_map["columns"].to_vector();
+        auto sels  = arg_map["selections"].to_vector();
+
+        emit recv_columnar(names, table, sels);
+        return;
+    }
+
     if (arg_map.size() < 4) {
         qDebug() << "Malformed subscribe reply";
         emit recv_fail("Bad subscription reply!");
@@ -18,6 +18,10 @@ signals:
               noo::AnyVarRef,
               noo::AnyVarListRef const&,
               noo::AnyVarListRef const&);
+
+    void recv_columnar(noo::AnyVarListRef const&,
+                       noo::ColumnarTable const&,
+                       noo::AnyVarListRef const&);
 };
 
 } // namespace nooc
@@ -42,6 +42,15 @@ public:
 
         auto& slot = m_list[at.id_slot];
 
+        if (slot and slot->id().id_gen < at.id_gen) {
+            // the slot was reused. we must have missed the delete of the
+            // old entity, so it goes now.
+            qDebug() << "Replacing" << slot->id().to_qstring() << "with newer"
+                     << at.to_qstring();
+            slot->prepare_delete();
+            slot.reset();
+        }
+
         if (slot) {
             if (slot->id() != at) {
                 qDebug() << "Server attempted to update an entity that does "
@@ -98,7 +107,7 @@ public:
         if (at.id_slot >= m_list.size()) return nullptr;
         auto& slot = m_list[at.id_slot];
 
-        if (slot->id() != at) return nullptr;
+        if (!slot or slot->id() != at) return nullptr;
         return slot;
     }
 
@@ -0,0 +1,165 @@
+#include "column_kernels.h"
+
+#include <algorithm>
+#include <limits>
+
+#if !defined(NOODLES_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define NOO_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace noo {
+
+namespace {
+
+constexpr double inf = std::numeric_limits<double>::infinity();
+
+// written so that a NaN value leaves the accumulator alone, which is also
+// what MINPD and MAXPD do when the value is the first operand
+inline double min_step(double acc, double v) {
+    return v < acc ? v : acc;
+}
+inline double max_step(double acc, double v) {
+    return v > acc ? v : acc;
+}
+
+#ifdef NOO_KERNELS_SSE2
+inline double low(__m128d a) {
+    return _mm_cvtsd_f64(a);
+}
+inline double high(__m128d a) {
+    return _mm_cvtsd_f64(_mm_unpackhi_pd(a, a));
+}
+#endif
+
+} // namespace
+
+char const* column_kernel_isa() {
+#if defined(NOO_KERNELS_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+double column_sum(std::span<double const> v) {
+    size_t i   = 0;
+    double ret = 0;
+
+#ifdef NOO_KERNELS_SSE2
+    // two accumulators to hide the latency of the adds
+    __m128d a = _mm_setzero_pd();
+    __m128d b = _mm_setzero_pd();
+
+    for (; i + 4 <= v.size(); i += 4) {
+        a = _mm_add_pd(a, _mm_loadu_pd(v.data() + i));
+        b = _mm_add_pd(b, _mm_loadu_pd(v.data() + i + 2));
+    }
+
+    a   = _mm_add_pd(a, b);
+    ret = low(a) + high(a);
+#endif
+
+    for (; i < v.size(); i++) {
+        ret += v[i];
+    }
+
+    return ret;
+}
+
+double column_min(std::span<double const> v) {
+    size_t i   = 0;
+    double ret = inf;
+
+#ifdef NOO_KERNELS_SSE2
+    __m128d a = _mm_set1_pd(inf);
+
+    for (; i + 2 <= v.size(); i += 2) {
+        a = _mm_min_pd(_mm_loadu_pd(v.data() + i), a);
+    }
+
+    ret = min_step(low(a), high(a));
+#endif
+
+    for (; i < v.size(); i++) {
+        ret = min_step(ret, v[i]);
+    }
+
+    return ret;
+}
+
+double column_max(std::span<double const> v) {
+    size_t i   = 0;
+    double ret = -inf;
+
+#ifdef NOO_KERNELS_SSE2
+    __m128d a = _mm_set1_pd(-inf);
+
+    for (; i + 2 <= v.size(); i += 2) {
+        a = _mm_max_pd(_mm_loadu_pd(v.data() + i), a);
+    }
+
+    ret = max_step(low(a), high(a));
+#endif
+
+    for (; i < v.size(); i++) {
+        ret = max_step(ret, v[i]);
+    }
+
+    return ret;
+}
+
+void column_and_range(std::span<double const> v,
+                      double                  lo,
+                      double                  hi,
+                      std::span<uint8_t>      mask) {
+    size_t const n = std::min(v.size(), mask.size());
+
+    size_t i = 0;
+
+#ifdef NOO_KERNELS_SSE2
+    __m128d const vlo = _mm_set1_pd(lo);
+    __m128d const vhi = _mm_set1_pd(hi);
+
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v.data() + i);
+
+        int bits = _mm_movemask_pd(
+            _mm_and_pd(_mm_cmpge_pd(x, vlo), _mm_cmple_pd(x, vhi)));
+
+        mask[i] &= uint8_t(bits & 1);
+        mask[i + 1] &= uint8_t(bits >> 1);
+    }
+#endif
+
+    for (; i < n; i++) {
+        mask[i] &= uint8_t((v[i] >= lo) & (v[i] <= hi));
+    }
+
+    // rows a short column does not reach cannot pass
+    for (i = n; i < mask.size(); i++) {
+        mask[i] = 0;
+    }
+}
+
+void column_gather(std::span<double const> v,
+                   std::span<size_t const> rows,
+                   std::span<double>       out) {
+    // SSE2 has no gather instruction, so this stays a plain loop, as
+    // column_scatter does
+    for (size_t i = 0; i < rows.size(); i++) {
+        out[i] = v[rows[i]];
+    }
+}
+
+void column_scatter(std::span<double const> values,
+                    std::span<size_t const> rows,
+                    std::span<double>       v) {
+    // there is no scatter instruction short of AVX-512, so this stays a plain
+    // loop; the win is in not dispatching on the cell type for every row
+    for (size_t i = 0; i < rows.size(); i++) {
+        v[rows[i]] = values[i];
+    }
+}
+
+} // namespace noo
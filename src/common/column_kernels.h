@@ -0,0 +1,48 @@
+#ifndef COLUMN_KERNELS_H
+#define COLUMN_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace noo {
+
+// Kernels over columns of reals. They use SSE2 where the compiler targets it,
+// with plain loops for other targets, or when built with NOODLES_NO_SIMD. Both
+// paths give the same results, apart from the order in which sums are added
+// up.
+
+/// Name of the instruction set the kernels were built for
+char const* column_kernel_isa();
+
+/// Sum of all values
+double column_sum(std::span<double const>);
+
+/// Smallest value, skipping NaNs. Infinity if there is nothing to compare.
+double column_min(std::span<double const>);
+
+/// Largest value, skipping NaNs. Negative infinity if there is nothing to
+/// compare.
+double column_max(std::span<double const>);
+
+/// mask[i] &= (lo <= v[i] <= hi). Flags past the end of v are cleared.
+void column_and_range(std::span<double const> v,
+                      double                  lo,
+                      double                  hi,
+                      std::span<uint8_t>      mask);
+
+/// out[i] = v[rows[i]]. Every row must be in range, and out must be as long
+/// as rows.
+void column_gather(std::span<double const> v,
+                   std::span<size_t const> rows,
+                   std::span<double>       out);
+
+/// v[rows[i]] = values[i]. Every row must be in range, and values must be as
+/// long as rows.
+void column_scatter(std::span<double const> values,
+                    std::span<size_t const> rows,
+                    std::span<double>       v);
+
+} // namespace noo
+
+#endif // COLUMN_KERNELS_H
@@ -0,0 +1,11 @@
+#include "logging.h"
+
+namespace noo {
+
+Q_LOGGING_CATEGORY(log_server, "noodles.server", QtInfoMsg)
+Q_LOGGING_CATEGORY(log_message, "noodles.message", QtInfoMsg)
+Q_LOGGING_CATEGORY(log_component, "noodles.component", QtInfoMsg)
+Q_LOGGING_CATEGORY(log_table, "noodles.table", QtInfoMsg)
+Q_LOGGING_CATEGORY(log_mesh, "noodles.mesh", QtInfoMsg)
+
+} // namespace noo
@@ -0,0 +1,28 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QLoggingCategory>
+
+namespace noo {
+
+// Debug output for these is off unless enabled with QT_LOGGING_RULES, for
+// example "noodles.message.debug=true". Builds that define QT_NO_DEBUG_OUTPUT
+// drop qCDebug statements entirely.
+
+Q_DECLARE_LOGGING_CATEGORY(log_server)
+Q_DECLARE_LOGGING_CATEGORY(log_message)
+Q_DECLARE_LOGGING_CATEGORY(log_component)
+Q_DECLARE_LOGGING_CATEGORY(log_table)
+Q_DECLARE_LOGGING_CATEGORY(log_mesh)
+
+} // namespace noo
+
+/// Guard debug output that is expensive to prepare. Compiles to false when
+/// debug output is stripped.
+#ifdef QT_NO_DEBUG_OUTPUT
+#define NOO_DEBUG_ENABLED(CATEGORY) false
+#else
+#define NOO_DEBUG_ENABLED(CATEGORY) CATEGORY().isDebugEnabled()
+#endif
+
+#endif // LOGGING_H
@@ -82,13 +82,15 @@ void LightT::write_new_to(Writer& w) {
 void LightT::update(LightData const& d, Writer& w) {
     m_data = d;
 
+    m_parent_list->mark_changed(id());
+
     write_new_to(w);
 }
 
 void LightT::update(LightData const& d) {
-    auto w = m_parent_list->new_bcast();
+    m_data = d;
 
-    update(d, *w);
+    m_parent_list->mark_dirty(*this);
 }
 void LightT::write_delete_to(Writer& w) {
     auto lid = convert_id(id(), w);
@@ -0,0 +1,272 @@
+#include "clientconnection.h"
+
+#include "incomingmessage.h"
+#include "src/common/logging.h"
+
+#include <QDebug>
+#include <QRunnable>
+#include <QTcpSocket>
+#include <QThreadPool>
+#include <QWebSocket>
+#include <QWebSocketServer>
+
+#include <functional>
+
+namespace noo {
+
+IncomingQueue::IncomingQueue(QObject* target, QThreadPool* verify_pool)
+    : m_target(target), m_verify_pool(verify_pool) { }
+
+quint64 IncomingQueue::next_client_id() {
+    return m_next_client_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IncomingQueue::verify_and_push(quint64 client_id, QByteArray bytes) {
+    auto ptr = std::make_shared<IncomingMessage>(std::move(bytes));
+
+    if (!ptr->get_root()) {
+        qCritical() << "Bad message from connection" << client_id;
+        ptr.reset();
+    }
+
+    push(client_id, std::move(ptr));
+}
+
+void IncomingQueue::push(quint64                          client_id,
+                         std::shared_ptr<IncomingMessage> message) {
+    bool was_empty = m_queue.push({ client_id, std::move(message) });
+
+    if (was_empty) {
+        QMetaObject::invokeMethod(
+            m_target, "drain_incoming", Qt::QueuedConnection);
+    }
+}
+
+// =============================================================================
+
+namespace {
+
+class VerifyTask : public QRunnable {
+    std::function<void()> m_function;
+
+public:
+    explicit VerifyTask(std::function<void()> f) : m_function(std::move(f)) { }
+
+    void run() override { m_function(); }
+};
+
+} // namespace
+
+VerifyChain::VerifyChain(std::shared_ptr<IncomingQueue> incoming,
+                         quint64                        client_id)
+    : m_incoming(std::move(incoming)), m_client_id(client_id) { }
+
+void VerifyChain::submit(QByteArray bytes) {
+    {
+        std::scoped_lock lock(m_mutex);
+
+        m_pending.push_back(std::move(bytes));
+
+        // a task is already working through this client's messages
+        if (m_running) return;
+
+        m_running = true;
+    }
+
+    m_incoming->verify_pool()->start(
+        new VerifyTask([self = shared_from_this()]() { self->run(); }));
+}
+
+void VerifyChain::run() {
+    while (true) {
+        QByteArray bytes;
+
+        {
+            std::scoped_lock lock(m_mutex);
+
+            if (m_pending.empty()) {
+                m_running = false;
+                return;
+            }
+
+            bytes = std::move(m_pending.front());
+            m_pending.pop_front();
+        }
+
+        m_incoming->verify_and_push(m_client_id, std::move(bytes));
+    }
+}
+
+// =============================================================================
+
+ClientConnection::ClientConnection(QWebSocket*                    socket,
+                                   std::shared_ptr<IncomingQueue> incoming,
+                                   ServerOptions const&           options,
+                                   QObject*                       parent)
+    : QObject(parent),
+      m_socket(socket),
+      m_id(incoming->next_client_id()),
+      m_incoming(std::move(incoming)),
+      m_options(options),
+      m_queue(options.client_conflate_threshold) {
+    socket->setParent(this);
+
+    if (m_incoming->verify_pool()) {
+        m_verifier = std::make_shared<VerifyChain>(m_incoming, m_id);
+    }
+
+    connect(socket,
+            &QWebSocket::disconnected,
+            this,
+            &ClientConnection::on_disconnected);
+    connect(socket,
+            &QWebSocket::bytesWritten,
+            this,
+            &ClientConnection::on_bytes_written);
+
+    connect(socket,
+            &QWebSocket::textMessageReceived,
+            this,
+            &ClientConnection::on_text);
+    connect(socket,
+            &QWebSocket::binaryMessageReceived,
+            this,
+            &ClientConnection::on_binary);
+
+    // the client may have left before we got here
+    if (socket->state() == QAbstractSocket::UnconnectedState) {
+        m_closed = true;
+    }
+}
+
+ClientConnection::~ClientConnection() {
+    qInfo() << "Connection" << m_id << "dropped" << m_queue.dropped_frames()
+            << "superseded frames," << m_queue.dropped_bytes() << "bytes";
+}
+
+void ClientConnection::send(MessageFrame frame) {
+    if (frame.isEmpty()) return;
+
+    m_queue.push(std::move(frame));
+
+    if (m_queue.queued_bytes() > m_options.client_conflate_threshold) {
+        auto dropped = m_queue.conflate();
+
+        qCDebug(log_server) << "Connection" << m_id << "is behind, dropped"
+                            << dropped << "bytes of superseded updates";
+    }
+
+    if (m_options.client_queue_limit and
+        m_queue.queued_bytes() > m_options.client_queue_limit) {
+        qWarning() << "Connection" << m_id << "has" << m_queue.queued_bytes()
+                   << "bytes waiting, disconnecting";
+        m_queue.clear();
+        close("Too far behind");
+        return;
+    }
+
+    pump();
+}
+
+void ClientConnection::close(QString reason) {
+    m_socket->close(QWebSocketProtocol::CloseCodeBadOperation, reason);
+}
+
+void ClientConnection::pump() {
+    auto const window = qint64(m_options.client_send_window);
+
+    while (!m_queue.empty() and m_in_flight < window) {
+        auto frame = m_queue.pop();
+
+        // the socket copies the data before returning
+        m_in_flight += m_socket->sendBinaryMessage(frame.view());
+    }
+}
+
+void ClientConnection::on_bytes_written(qint64 count) {
+    // the socket also counts websocket framing, so this only approximates
+    // what is left to write
+    m_in_flight = std::max<qint64>(0, m_in_flight - count);
+
+    pump();
+}
+
+void ClientConnection::on_disconnected() {
+    m_closed = true;
+    emit closed();
+}
+
+void ClientConnection::on_text(QString text) {
+    qWarning() << "Text not supported!" << text;
+}
+
+void ClientConnection::on_binary(QByteArray array) {
+    if (m_verifier) {
+        m_verifier->submit(std::move(array));
+        return;
+    }
+
+    m_incoming->verify_and_push(m_id, std::move(array));
+}
+
+// =============================================================================
+
+IOWorker::IOWorker(std::shared_ptr<IncomingQueue> incoming,
+                   ServerOptions const&           options)
+    : m_incoming(std::move(incoming)), m_options(options) {
+
+    // never listens; sockets are handed to it after they are accepted
+    m_socket_server = new QWebSocketServer(QStringLiteral("Noodles Server"),
+                                           QWebSocketServer::NonSecureMode,
+                                           this);
+
+    connect(m_socket_server,
+            &QWebSocketServer::newConnection,
+            this,
+            &IOWorker::on_new_connection);
+}
+
+void IOWorker::adopt(qintptr descriptor) {
+    auto* socket = new QTcpSocket();
+
+    if (!socket->setSocketDescriptor(descriptor)) {
+        qWarning() << "Unable to take socket:" << socket->errorString();
+        delete socket;
+        return;
+    }
+
+    m_socket_server->handleConnection(socket);
+}
+
+void IOWorker::drop(ClientConnection* connection) {
+    delete connection;
+}
+
+void IOWorker::on_new_connection() {
+    while (m_socket_server->hasPendingConnections()) {
+        QWebSocket* socket = m_socket_server->nextPendingConnection();
+
+        auto* connection =
+            new ClientConnection(socket, m_incoming, m_options, this);
+
+        emit connection_ready(connection);
+    }
+}
+
+// =============================================================================
+
+IOListener::IOListener(std::vector<IOWorker*> workers, QObject* parent)
+    : QTcpServer(parent), m_workers(std::move(workers)) {
+    Q_ASSERT(!m_workers.empty());
+}
+
+void IOListener::incomingConnection(qintptr descriptor) {
+    IOWorker* worker = m_workers[m_next];
+
+    m_next = (m_next + 1) % m_workers.size();
+
+    QMetaObject::invokeMethod(
+        worker, "adopt", Qt::QueuedConnection, Q_ARG(qintptr, descriptor));
+}
+
+} // namespace noo
@@ -0,0 +1,193 @@
+#ifndef CLIENTCONNECTION_H
+#define CLIENTCONNECTION_H
+
+#include "include/noo_server_interface.h"
+#include "messageframe.h"
+#include "mpscqueue.h"
+#include "outboundqueue.h"
+
+#include <QObject>
+#include <QTcpServer>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class QThreadPool;
+class QWebSocket;
+class QWebSocketServer;
+
+namespace noo {
+
+class IncomingMessage;
+
+struct IncomingEnvelope {
+    quint64 client_id;
+
+    /// Null if the client sent a message that failed verification
+    std::shared_ptr<IncomingMessage> message;
+};
+
+///
+/// \brief The IncomingQueue class carries messages from client connections,
+/// which may live on I/O threads, to the thread that owns the document.
+///
+/// The target is woken with a queued call to its drain_incoming() slot when
+/// the queue goes from empty to non-empty.
+///
+class IncomingQueue {
+    MPSCQueue<IncomingEnvelope> m_queue;
+
+    std::atomic<quint64> m_next_client_id { 1 };
+
+    QObject*     m_target;
+    QThreadPool* m_verify_pool;
+
+public:
+    /// If a pool is given, messages are verified on it
+    IncomingQueue(QObject* target, QThreadPool* verify_pool);
+
+    quint64 next_client_id();
+
+    QThreadPool* verify_pool() const { return m_verify_pool; }
+
+    /// Verify a message and queue it. Any thread
+    void verify_and_push(quint64 client_id, QByteArray);
+
+    /// Any thread
+    void push(quint64 client_id, std::shared_ptr<IncomingMessage>);
+
+    /// Target thread ONLY
+    template <class Function>
+    size_t drain(Function&& f) {
+        return m_queue.drain(std::forward<Function>(f));
+    }
+};
+
+///
+/// \brief The VerifyChain class verifies the messages of one client on a
+/// thread pool, one at a time, so that they are queued in the order they
+/// arrived.
+///
+class VerifyChain : public std::enable_shared_from_this<VerifyChain> {
+    std::shared_ptr<IncomingQueue> m_incoming;
+    quint64                        m_client_id;
+
+    std::mutex             m_mutex;
+    std::deque<QByteArray> m_pending;
+    bool                   m_running = false;
+
+    void run();
+
+public:
+    VerifyChain(std::shared_ptr<IncomingQueue>, quint64 client_id);
+
+    void submit(QByteArray);
+};
+
+///
+/// \brief The ClientConnection class owns the socket of a client, and lives on
+/// the thread that does I/O for it.
+///
+/// Frames to send arrive through the send() slot, and are held in an outbound
+/// queue while the socket is behind. Incoming messages are verified here, or on
+/// the verification pool, and then pushed to the incoming queue.
+///
+class ClientConnection : public QObject {
+    Q_OBJECT
+
+    QWebSocket* m_socket;
+    quint64     m_id;
+
+    std::shared_ptr<IncomingQueue> m_incoming;
+    std::shared_ptr<VerifyChain>   m_verifier;
+
+    ServerOptions m_options;
+
+    // frames waiting for the socket to catch up
+    OutboundQueue m_queue;
+    qint64        m_in_flight = 0;
+
+    // set before closed() is emitted
+    std::atomic<bool> m_closed = false;
+
+    void pump();
+
+public:
+    ClientConnection(QWebSocket*,
+                     std::shared_ptr<IncomingQueue>,
+                     ServerOptions const&,
+                     QObject* parent);
+    ~ClientConnection();
+
+    quint64 id() const { return m_id; }
+
+    /// True once the socket has disconnected. Any thread
+    bool is_closed() const { return m_closed.load(); }
+
+public slots:
+    void send(MessageFrame);
+    void close(QString reason);
+
+private slots:
+    void on_text(QString);
+    void on_binary(QByteArray);
+    void on_bytes_written(qint64);
+    void on_disconnected();
+
+signals:
+    void closed();
+};
+
+///
+/// \brief The IOWorker class accepts sockets on an I/O thread and creates
+/// connections for them.
+///
+class IOWorker : public QObject {
+    Q_OBJECT
+
+    QWebSocketServer* m_socket_server;
+
+    std::shared_ptr<IncomingQueue> m_incoming;
+
+    ServerOptions m_options;
+
+public:
+    IOWorker(std::shared_ptr<IncomingQueue>, ServerOptions const&);
+
+public slots:
+    /// Take over an accepted socket
+    void adopt(qintptr descriptor);
+
+    /// Delete a connection this worker created
+    void drop(ClientConnection*);
+
+private slots:
+    void on_new_connection();
+
+signals:
+    void connection_ready(ClientConnection*);
+};
+
+///
+/// \brief The IOListener class accepts TCP connections and hands them out to
+/// I/O workers in turn.
+///
+class IOListener : public QTcpServer {
+    Q_OBJECT
+
+    std::vector<IOWorker*> m_workers;
+    size_t                 m_next = 0;
+
+public:
+    IOListener(std::vector<IOWorker*> workers, QObject* parent);
+
+protected:
+    void incomingConnection(qintptr descriptor) override;
+};
+
+} // namespace noo
+
+#endif // CLIENTCONNECTION_H
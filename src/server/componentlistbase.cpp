@@ -7,8 +7,27 @@ namespace noo {
 
 ComponentListRock::ComponentListRock(ServerT* s) : m_server(s) { }
 
-std::unique_ptr<Writer> ComponentListRock::new_bcast() {
+ComponentListRock::~ComponentListRock() {
+    if (m_dirty_registered) m_server->forget_dirty_list(this);
+}
+
+Writer ComponentListRock::new_bcast() {
     return m_server->get_broadcast_writer();
 }
 
+size_t ComponentListRock::max_frame_size() const {
+    return m_server->options().max_frame_size;
+}
+
+void ComponentListRock::write_pending_updates() {
+    m_server->write_dirty_lists();
+}
+
+void ComponentListRock::request_dirty_flush() {
+    if (m_dirty_registered) return;
+
+    m_dirty_registered = true;
+    m_server->add_dirty_list(this);
+}
+
 } // namespace noo
@@ -2,10 +2,17 @@
 #define COMPONENTLISTBASE_H
 
 #include "serialize.h"
+#include "src/common/logging.h"
 
 #include <QDebug>
 #include <QObject>
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <span>
 #include <vector>
 
 namespace noo {
@@ -18,7 +25,8 @@ template <class Derived, class IDType, class T>
 class ComponentListBase;
 
 template <class Derived, class List, class _IDType>
-class ComponentMixin : public QObject {
+class ComponentMixin : public QObject,
+                       public std::enable_shared_from_this<Derived> {
     Derived&       as_derived() { return *static_cast<Derived*>(this); }
     Derived const& as_derived() const {
         return *static_cast<Derived const*>(this);
@@ -28,14 +36,20 @@ protected:
     _IDType m_id;
     List*   m_parent_list;
 
+    // an update is waiting for the next flush
+    bool m_dirty = false;
+
 public:
     using IDType = _IDType;
 
     ComponentMixin(_IDType id, List* d) : m_id(id), m_parent_list(d) { }
 
     ~ComponentMixin() {
+        // pending updates of other components may still refer to this one
+        m_parent_list->write_pending_updates();
+
         auto w = m_parent_list->new_bcast();
-        as_derived().write_delete_to(*w);
+        as_derived().write_delete_to(w);
 
         m_parent_list->mark_free(m_id);
     }
@@ -48,16 +62,44 @@ public:
 
     auto  id() const { return m_id; }
     List* hosting_list() const { return m_parent_list; }
+
+    bool is_dirty() const { return m_dirty; }
+    void set_dirty(bool b) { m_dirty = b; }
 };
 
 struct ComponentListRock {
     ServerT* m_server;
 
-    std::unique_ptr<Writer> new_bcast();
+    // registered with the server to write dirty components at the next flush
+    bool m_dirty_registered = false;
+
+    Writer new_bcast();
 
     ComponentListRock(ServerT*);
+    virtual ~ComponentListRock();
 
     ServerT* server() const { return m_server; }
+
+    size_t max_frame_size() const;
+
+    void request_dirty_flush();
+
+    /// Write the dirty components of every list now
+    void write_pending_updates();
+
+    /// Write an update for each dirty component. Called by the server.
+    virtual void write_dirty() { }
+};
+
+///
+/// \brief The SnapshotChunk struct holds the encoded creation messages for a
+/// fixed range of slots in a component list.
+///
+struct SnapshotChunk {
+    static constexpr size_t SLOT_COUNT = 1024;
+
+    bool                      valid = false;
+    std::vector<MessageFrame> frames;
 };
 
 
@@ -69,14 +111,129 @@ class ComponentListBase : public ComponentListRock {
     }
 
 protected:
-    using CompPtr = std::weak_ptr<T>;
+    ///
+    /// \brief The Slot struct holds a component in place, along with the
+    /// slot's generation. The generation is checked before the component is
+    /// touched.
+    ///
+    struct Slot {
+        alignas(T) std::byte storage[sizeof(T)];
+
+        uint32_t gen  = 0;
+        bool     live = false;
+
+        T* get() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    // components are QObjects with shared addresses and cannot be moved, so
+    // slots live in fixed blocks that are never reallocated
+    static constexpr size_t BLOCK_SIZE = 256;
+
+    ///
+    /// \brief The Storage struct owns the slot blocks. Handles to components
+    /// share it, so that a handle dropped after the list is gone neither
+    /// touches the list nor freed memory.
+    ///
+    struct Storage {
+        std::vector<std::unique_ptr<Slot[]>> blocks;
+
+        // null once the list is destroyed
+        ComponentListBase* list = nullptr;
+    };
+
+    std::shared_ptr<Storage> m_storage;
+    size_t                   m_slot_count = 0;
+
+    std::vector<IDType> m_free_list;
+
+    // may hold ids of components deleted since they were marked
+    std::vector<IDType> m_dirty;
+
+    // components released while for_all runs are destroyed when it is done
+    size_t          m_iterating = 0;
+    std::vector<T*> m_deferred;
+
+    std::vector<SnapshotChunk>    m_snapshot;
+    std::unique_ptr<MessageBatch> m_snapshot_batch;
+
+    Slot& slot_at(size_t i) const {
+        return m_storage->blocks[i / BLOCK_SIZE][i % BLOCK_SIZE];
+    }
+
+    void grow_to(size_t count) {
+        auto& blocks = m_storage->blocks;
+
+        while (blocks.size() * BLOCK_SIZE < count) {
+            blocks.push_back(std::make_unique<Slot[]>(BLOCK_SIZE));
+        }
+
+        m_slot_count = count;
+    }
+
+    template <class... Args>
+    std::shared_ptr<T> construct_at(IDType place, Args&&... args) {
+        auto& slot = slot_at(place.id_slot);
+
+        Q_ASSERT(!slot.live);
+
+        T* ptr = new (slot.storage)
+            T(place, &as_derived(), std::forward<Args>(args)...);
+
+        slot.gen  = place.id_gen;
+        slot.live = true;
 
-    std::vector<CompPtr> m_list;
-    std::vector<IDType>  m_free_list;
+        return std::shared_ptr<T>(ptr, [storage = m_storage](T* p) {
+            // the list destroyed the component already if it is gone
+            if (storage->list) storage->list->release(p);
+        });
+    }
+
+    void release(T* ptr) {
+        // hidden from lookups and iteration right away
+        slot_at(ptr->id().id_slot).live = false;
+
+        if (m_iterating) {
+            m_deferred.push_back(ptr);
+            return;
+        }
+
+        ptr->~T();
+    }
+
+    void release_deferred() {
+        while (!m_deferred.empty()) {
+            auto deferred = std::move(m_deferred);
+            m_deferred.clear();
+
+            for (auto* ptr : deferred) {
+                ptr->~T();
+            }
+        }
+    }
 
 public:
-    ComponentListBase(ServerT* s) : ComponentListRock(s) { }
-    ~ComponentListBase() = default;
+    ComponentListBase(ServerT* s)
+        : ComponentListRock(s), m_storage(std::make_shared<Storage>()) {
+        m_storage->list = this;
+    }
+
+    /// Destroys every component still alive. Handles to them that outlive the
+    /// list may only be dropped.
+    ~ComponentListBase() {
+        release_deferred();
+
+        // releases from here on are ours to do, and would otherwise destroy
+        // a component twice
+        m_storage->list = nullptr;
+
+        for (size_t i = 0; i < m_slot_count; i++) {
+            auto& slot = slot_at(i);
+            if (!slot.live) continue;
+
+            slot.live = false;
+            slot.get()->~T();
+        }
+    }
 
     template <class... Args>
     std::shared_ptr<T> provision_next(Args&&... args) {
@@ -87,70 +244,222 @@ public:
             place = m_free_list.back();
             m_free_list.pop_back();
         } else {
-            size_t slot = m_list.size();
-
-            place = IDType(slot, 0);
+            place = IDType(m_slot_count, 0);
 
-            m_list.emplace_back();
+            grow_to(m_slot_count + 1);
         }
 
-        auto nptr = std::make_shared<T>(
-            place, &as_derived(), std::forward<Args>(args)...);
+        auto nptr = construct_at(place, std::forward<Args>(args)...);
 
-        auto& slot = m_list[place.id_slot];
+        on_create(*nptr);
 
-        Q_ASSERT(slot.expired());
+        return nptr;
+    }
 
-        slot = nptr;
+    /// Create a component for each of the given data. Free slots are used
+    /// first, and the list grows at most once.
+    template <class Data>
+    std::vector<std::shared_ptr<T>> provision_many(std::span<Data const> data) {
+        std::vector<std::shared_ptr<T>> ret;
+        ret.reserve(data.size());
 
-        on_create(*nptr);
+        auto const reused = std::min(data.size(), m_free_list.size());
 
-        return nptr;
+        std::vector<IDType> places(m_free_list.end() - reused,
+                                   m_free_list.end());
+
+        m_free_list.resize(m_free_list.size() - reused);
+
+        // free slots are taken from the back, as in provision_next
+        std::reverse(places.begin(), places.end());
+
+        auto const first_new = m_slot_count;
+
+        grow_to(first_new + (data.size() - reused));
+
+        for (size_t i = first_new; i < m_slot_count; i++) {
+            places.emplace_back(i, 0);
+        }
+
+        for (size_t i = 0; i < data.size(); i++) {
+            auto nptr = construct_at(places[i], data[i]);
+
+            // these all go out in the same frames
+            on_create(*nptr);
+
+            ret.push_back(std::move(nptr));
+        }
+
+        return ret;
     }
 
     void mark_free(IDType id) {
-        qDebug() << typeid(Derived).name() << "Marking free" << id.id_slot
-                 << id.id_gen;
-        auto& slot = m_list.at(id.id_slot);
-
-        auto ptr = slot.lock();
-
-        if (ptr) {
-            // by the semantics of smart pointers, the ref counts will be bad by
-            // the time we get here.
-            // but just in case we DO have a lock...
-            if (ptr->id() != id)
-                throw std::runtime_error("Trying to free bad id!");
+        qCDebug(log_component) << typeid(Derived).name() << "Marking free"
+                               << id.id_slot << id.id_gen;
+        if (id.id_slot >= m_slot_count or
+            slot_at(id.id_slot).gen != id.id_gen) {
+            throw std::runtime_error("Trying to free bad id!");
+        }
+
+        // the next component in this slot gets a new generation, so stale ids
+        // never match it. a slot that runs out of generations is retired.
+        if (id.id_gen + 1 < IDType::INVALID) {
+            m_free_list.emplace_back(id.id_slot, id.id_gen + 1);
         }
 
-        m_free_list.push_back(id);
+        slot_at(id.id_slot).live = false;
 
-        slot = {};
+        mark_changed(id);
     }
 
-    std::shared_ptr<T> get_at(IDType id) const {
-        auto& slot = m_list.at(id.id_slot);
+    /// Invalidate the cached snapshot encoding of the given component.
+    void mark_changed(IDType id) {
+        auto chunk = id.id_slot / SnapshotChunk::SLOT_COUNT;
+        if (chunk < m_snapshot.size()) m_snapshot[chunk].valid = false;
+    }
 
-        auto ptr = slot.lock();
+    /// Have a component write an update at the next flush, or before the next
+    /// message of any other kind, instead of right away. Further changes
+    /// before then go out in the same update.
+    void mark_dirty(T& t) {
+        mark_changed(t.id());
 
-        if (!ptr) return nullptr;
+        if (t.is_dirty()) return;
+
+        t.set_dirty(true);
+        m_dirty.push_back(t.id());
+
+        request_dirty_flush();
+    }
+
+    void write_dirty() override {
+        m_dirty_registered = false;
+
+        auto dirty = std::move(m_dirty);
+        m_dirty.clear();
+
+        for (auto id : dirty) {
+            auto ptr = get_at(id);
+
+            // a deleted component has sent its delete already
+            if (!ptr or !ptr->is_dirty()) continue;
+
+            ptr->set_dirty(false);
+
+            auto w = new_bcast();
+
+            // components that send partial updates know what changed, for
+            // the rest the create message carries the full state
+            if constexpr (requires { ptr->write_dirty_to(w); }) {
+                ptr->write_dirty_to(w);
+            } else {
+                ptr->write_new_to(w);
+            }
+        }
+    }
+
+    /// Get the component with the given id, if it is still alive.
+    T* get_raw(IDType id) const {
+        if (id.id_slot >= m_slot_count) {
+            throw std::out_of_range("Component slot out of range");
+        }
+
+        auto& slot = slot_at(id.id_slot);
 
-        if (ptr->id() != id) return nullptr;
+        if (!slot.live or slot.gen != id.id_gen) return nullptr;
 
-        return ptr;
+        return slot.get();
+    }
+
+    std::shared_ptr<T> get_at(IDType id) const {
+        T* ptr = get_raw(id);
+
+        if (!ptr) return nullptr;
+
+        // the caller shares ownership, so this is the one place a reference
+        // count is taken
+        return ptr->weak_from_this().lock();
     }
 
     void on_create(T& t) {
+        mark_changed(t.id());
+
         auto w = new_bcast();
-        t.write_new_to(*w);
+        t.write_new_to(w);
+    }
+
+    /// Append frames that create every component in this list. Encoded frames
+    /// are cached in chunks of slots, and only chunks that changed since the
+    /// last call are encoded again.
+    void write_snapshot_to(std::vector<MessageFrame>& frames) {
+        auto const chunk_count =
+            (m_slot_count + SnapshotChunk::SLOT_COUNT - 1) /
+            SnapshotChunk::SLOT_COUNT;
+
+        m_snapshot.resize(chunk_count);
+
+        for (size_t ci = 0; ci < chunk_count; ci++) {
+            auto& chunk = m_snapshot[ci];
+
+            if (!chunk.valid) encode_chunk(ci, chunk);
+
+            frames.insert(frames.end(), chunk.frames.begin(), chunk.frames.end());
+        }
     }
 
+private:
+    void encode_chunk(size_t ci, SnapshotChunk& chunk) {
+        if (!m_snapshot_batch) {
+            m_snapshot_batch = std::make_unique<MessageBatch>(nullptr, nullptr);
+        }
+
+        auto& batch = *m_snapshot_batch;
+
+        chunk.frames.clear();
+
+        auto const first = ci * SnapshotChunk::SLOT_COUNT;
+        auto const last =
+            std::min(first + SnapshotChunk::SLOT_COUNT, m_slot_count);
+
+        auto const max_size = max_frame_size();
+
+        for (size_t i = first; i < last; i++) {
+            auto& slot = slot_at(i);
+            if (!slot.live) continue;
+
+            Writer w(batch);
+            slot.get()->write_new_to(w);
+
+            if (batch.pending_bytes() >= max_size) {
+                chunk.frames.push_back(batch.take());
+            }
+        }
+
+        if (!batch.empty()) chunk.frames.push_back(batch.take());
+
+        chunk.valid = true;
+    }
+
+public:
+    /// Call the function on every live component, in slot order. Components
+    /// released by the callback are destroyed once iteration is done, so no
+    /// reference is taken for each call.
     template <class Function>
-    void for_all(Function&& f) const {
-        for (auto const& wptr : m_list) {
-            auto ptr = wptr.lock();
-            if (!ptr) continue;
-            f(*ptr);
+    void for_all(Function&& f) {
+        struct Guard {
+            ComponentListBase* list;
+            ~Guard() {
+                if (--list->m_iterating == 0) list->release_deferred();
+            }
+        };
+
+        m_iterating++;
+        Guard guard { this };
+
+        // by index, as the callback may create components and grow the list
+        for (size_t i = 0; i < m_slot_count; i++) {
+            auto& slot = slot_at(i);
+            if (slot.live) f(*slot.get());
         }
     }
 };
@@ -0,0 +1,36 @@
+#define FLATBUFFERS_DEBUG_VERIFICATION_FAILURE
+
+#include "incomingmessage.h"
+
+#include "src/common/logging.h"
+
+#include <QDebug>
+
+namespace noo {
+
+IncomingMessage::IncomingMessage(QByteArray bytes) {
+    // need to hold onto where our data is coming from
+    // as the reader uses refs to it. only const access from here on, so the
+    // shared data is never detached and copied.
+    m_data_ref = std::move(bytes);
+
+    auto const* data =
+        reinterpret_cast<uint8_t const*>(m_data_ref.constData());
+
+    {
+        flatbuffers::Verifier v(data, m_data_ref.size());
+
+        if (!noodles::VerifyClientMessagesBuffer(v)) {
+            qCritical() << "Bad message!";
+            return;
+        }
+        qCDebug(log_message)
+            << "Message verified," << m_data_ref.size() << "bytes";
+    }
+
+    m_messages = noodles::GetClientMessages(data);
+}
+
+IncomingMessage::~IncomingMessage() noexcept { }
+
+} // namespace noo
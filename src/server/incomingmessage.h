@@ -0,0 +1,30 @@
+#ifndef INCOMINGMESSAGE_H
+#define INCOMINGMESSAGE_H
+
+#include "src/generated/noodles_client_generated.h"
+
+#include <QByteArray>
+
+namespace noo {
+
+///
+/// \brief The IncomingMessage class holds a verified message from a client.
+///
+/// Verification happens on construction, on whatever thread received the
+/// message; get_root() is null if the message was bad.
+///
+class IncomingMessage {
+    QByteArray m_data_ref;
+
+    noodles::ClientMessages const* m_messages = nullptr;
+
+public:
+    IncomingMessage(QByteArray bytes);
+    ~IncomingMessage() noexcept;
+
+    noodles::ClientMessages const* get_root() { return m_messages; }
+};
+
+} // namespace noo
+
+#endif // INCOMINGMESSAGE_H
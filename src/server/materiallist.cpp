@@ -38,14 +38,16 @@ void MaterialT::write_new_to(Writer& w) {
 void MaterialT::update(MaterialData const& d, Writer& w) {
     m_data = d;
 
+    m_parent_list->mark_changed(id());
+
     // same message is used
     write_new_to(w);
 }
 
 void MaterialT::update(MaterialData const& data) {
-    auto w = m_parent_list->new_bcast();
+    m_data = data;
 
-    update(data, *w);
+    m_parent_list->mark_dirty(*this);
 }
 
 void MaterialT::write_delete_to(Writer& w) {
@@ -59,13 +59,15 @@ void MeshT::write_new_to(Writer& w) {
 void MeshT::update(MeshData const& data, Writer& w) {
     m_data = data;
 
+    m_parent_list->mark_changed(id());
+
     write_new_to(w);
 }
 
 void MeshT::update(MeshData const& data) {
-    auto w = m_parent_list->new_bcast();
+    m_data = data;
 
-    update(data, *w);
+    m_parent_list->mark_dirty(*this);
 }
 
 void MeshT::write_delete_to(Writer& w) {
@@ -0,0 +1,43 @@
+#ifndef MESSAGEFRAME_H
+#define MESSAGEFRAME_H
+
+#include <QByteArray>
+#include <QMetaType>
+
+namespace noo {
+
+///
+/// \brief The MessageFrame class is a finished ServerMessages buffer, ready to
+/// be sent.
+///
+/// The frame is a range inside a larger storage array, as flatbuffers are
+/// built from the back of their buffer. Copies of a frame share the storage.
+///
+class MessageFrame {
+    QByteArray m_storage;
+    int        m_offset = 0;
+    int        m_size   = 0;
+
+public:
+    MessageFrame() = default;
+    MessageFrame(QByteArray storage, int offset, int size)
+        : m_storage(std::move(storage)), m_offset(offset), m_size(size) { }
+
+    explicit MessageFrame(QByteArray bytes)
+        : m_storage(std::move(bytes)), m_size(m_storage.size()) { }
+
+    bool isEmpty() const { return m_size == 0; }
+    int  size() const { return m_size; }
+
+    char const* data() const { return m_storage.constData() + m_offset; }
+
+    /// Get a byte array that refers to the frame without copying. The
+    /// returned array is only valid while this frame is alive.
+    QByteArray view() const { return QByteArray::fromRawData(data(), m_size); }
+};
+
+} // namespace noo
+
+Q_DECLARE_METATYPE(noo::MessageFrame)
+
+#endif // MESSAGEFRAME_H
@@ -4,6 +4,7 @@
 #include "noodlesserver.h"
 #include "noodlesstate.h"
 #include "serialize.h"
+#include "src/common/logging.h"
 #include "src/common/variant_tools.h"
 #include "src/generated/noodles_server_generated.h"
 
@@ -17,8 +18,8 @@ MethodList::~MethodList() = default;
 MethodT::MethodT(IDType id, MethodList* host, MethodData const& d)
     : ComponentMixin(id, host), m_data(d) {
 
-    qDebug() << "NEW METHOD" << id.id_slot << id.id_gen
-             << m_data.method_name.c_str();
+    qCDebug(log_component) << "NEW METHOD" << id.id_slot << id.id_gen
+                           << m_data.method_name.c_str();
 }
 
 auto write_to(Arg const& ma, flatbuffers::FlatBufferBuilder& b) {
@@ -89,45 +90,49 @@ void SignalT::write_delete_to(Writer& w) {
 void SignalT::fire(std::variant<std::monostate, TableID, ObjectID> context,
                    AnyVarList&&                                    v) {
 
-    std::unique_ptr<Writer> w = [&]() {
-        if (std::holds_alternative<TableID>(context)) {
-            try {
-                TableTPtr ptr = m_parent_list->server()
-                                    ->state()
-                                    ->document()
-                                    ->table_list()
-                                    .get_at(std::get<TableID>(context));
+    if (std::holds_alternative<TableID>(context)) {
+        try {
+            TableTPtr ptr = m_parent_list->server()
+                                ->state()
+                                ->document()
+                                ->table_list()
+                                .get_at(std::get<TableID>(context));
 
-                return m_parent_list->server()->get_table_subscribers_writer(
-                    *ptr);
-            } catch (...) { return std::unique_ptr<Writer>(); }
+            // each subscriber encoding has its own batch
+            if (ptr) ptr->fire_to_whole_table(*this, std::move(v));
+        } catch (...) { }
 
-        } else {
-            return m_parent_list->new_bcast();
-        }
-    }();
+        return;
+    }
 
+    fire(context, std::move(v), m_parent_list->server()->broadcast_batch());
+}
+
+void SignalT::fire(std::variant<std::monostate, TableID, ObjectID> context,
+                   AnyVarList&&                                    v,
+                   MessageBatch&                                   batch) {
+    Writer w(batch);
 
-    auto noodles_id = convert_id(id(), *w);
+    auto noodles_id = convert_id(id(), w);
 
-    auto var = write_to(std::move(v), *w);
+    auto var = write_to(std::move(v), w);
 
 
     auto x = VMATCH(
         context,
         VCASE(std::monostate) {
-            return noodles::CreateSignalInvoke(*w, noodles_id, {}, {}, var);
+            return noodles::CreateSignalInvoke(w, noodles_id, {}, {}, var);
         },
         VCASE(TableID tid) {
-            auto noodles_tbl_id = convert_id(tid, *w);
-            return CreateSignalInvoke(*w, noodles_id, {}, noodles_tbl_id, var);
+            auto noodles_tbl_id = convert_id(tid, w);
+            return CreateSignalInvoke(w, noodles_id, {}, noodles_tbl_id, var);
         },
         VCASE(ObjectID oid) {
-            auto noodles_obj_id = convert_id(oid, *w);
-            return CreateSignalInvoke(*w, noodles_id, noodles_obj_id, {}, var);
+            auto noodles_obj_id = convert_id(oid, w);
+            return CreateSignalInvoke(w, noodles_id, noodles_obj_id, {}, var);
         });
 
-    w->complete_message(x);
+    w.complete_message(x);
 }
 
 // void write_to(SignalTPtr const& ptr, ::noodles_interface::SignalID::Builder
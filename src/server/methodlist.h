@@ -53,6 +53,11 @@ public:
 
 
     void fire(std::variant<std::monostate, TableID, ObjectID> id, AnyVarList&&);
+
+    /// Fire into a specific batch, instead of the one the context implies
+    void fire(std::variant<std::monostate, TableID, ObjectID> id,
+              AnyVarList&&,
+              MessageBatch&);
 };
 
 // void write_to(NoodlesSignalTPtr const&,
@@ -0,0 +1,79 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace noo {
+
+///
+/// \brief The MPSCQueue class is a lock-free queue for many producer threads
+/// and a single consumer thread.
+///
+/// Producers push onto an intrusive stack; the consumer takes the whole stack
+/// at once and reverses it, so items come out in the order they were pushed.
+///
+template <class T>
+class MPSCQueue {
+    struct Node {
+        T     value;
+        Node* next;
+    };
+
+    std::atomic<Node*> m_head { nullptr };
+
+public:
+    MPSCQueue() = default;
+    ~MPSCQueue() {
+        drain([](T&&) {});
+    }
+
+    MPSCQueue(MPSCQueue const&) = delete;
+    MPSCQueue& operator=(MPSCQueue const&) = delete;
+
+    /// Add an item. Returns true if the queue was empty, in which case the
+    /// consumer should be woken.
+    bool push(T value) {
+        auto* node = new Node { std::move(value), nullptr };
+
+        node->next = m_head.load(std::memory_order_relaxed);
+
+        while (!m_head.compare_exchange_weak(node->next,
+                                             node,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) { }
+
+        return node->next == nullptr;
+    }
+
+    /// Take every item pushed so far, oldest first. Consumer thread ONLY.
+    template <class Function>
+    size_t drain(Function&& f) {
+        Node* list = m_head.exchange(nullptr, std::memory_order_acquire);
+
+        Node* ordered = nullptr;
+
+        while (list) {
+            Node* next = list->next;
+            list->next = ordered;
+            ordered    = list;
+            list       = next;
+        }
+
+        size_t count = 0;
+
+        while (ordered) {
+            Node* next = ordered->next;
+            f(std::move(ordered->value));
+            delete ordered;
+            ordered = next;
+            count++;
+        }
+
+        return count;
+    }
+};
+
+} // namespace noo
+
+#endif // MPSCQUEUE_H
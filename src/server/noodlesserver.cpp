@@ -1,113 +1,171 @@
-#define FLATBUFFERS_DEBUG_VERIFICATION_FAILURE
-
 #include "noodlesserver.h"
 
+#include "clientconnection.h"
+#include "incomingmessage.h"
 #include "noodlesstate.h"
 #include "serialize.h"
+#include "src/common/logging.h"
 #include "src/generated/noodles_client_generated.h"
 
 #include <QDebug>
 #include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
 #include <QWebSocket>
 #include <QWebSocketServer>
 
 namespace noo {
 
-class IncomingMessage {
-    QByteArray m_data_ref;
+ClientT::ClientT(ClientConnection* connection,
+                 IOWorker*         worker,
+                 ServerT*          server)
+    : QObject(server),
+      m_connection(connection),
+      m_worker(worker),
+      m_id(connection->id()) {
+
+    // on our thread, the connection goes when we do
+    if (!worker) connection->setParent(this);
+
+    m_batch = new MessageBatch(server, this);
+
+    connect(m_batch, &MessageBatch::data_ready, this, &ClientT::send);
+
+    // queued if the connection lives on an I/O thread
+    connect(this,
+            &ClientT::frame_ready,
+            connection,
+            &ClientConnection::send);
+    connect(this,
+            &ClientT::close_requested,
+            connection,
+            &ClientConnection::close);
+    connect(connection,
+            &ClientConnection::closed,
+            this,
+            &ClientT::on_connection_closed);
+}
 
-    noodles::ClientMessages const* m_messages = nullptr;
+ClientT::~ClientT() {
+    qInfo() << "Client" << m_name << "closed, sent" << m_bytes_counter
+            << "bytes";
 
-public:
-    IncomingMessage(QByteArray bytes) {
-        qDebug() << Q_FUNC_INFO << bytes.size();
+    // a worker is only deleted after its thread has been stopped, so it
+    // cannot go away while we look at it here
+    if (m_worker) {
+        QMetaObject::invokeMethod(
+            m_worker,
+            [worker = m_worker.data(), connection = m_connection]() {
+                worker->drop(connection);
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+quint64 ClientT::id() const {
+    return m_id;
+}
+
+void ClientT::set_name(std::string const& s) {
+    m_name = QString::fromStdString(s);
+    qCDebug(log_server) << "Identifying ClientT" << m_id << "as" << m_name;
+}
 
-        // need to hold onto where our data is coming from
-        // as the reader uses refs to it.
-        m_data_ref = bytes;
+MessageBatch& ClientT::batch() {
+    return *m_batch;
+}
 
-        {
-            flatbuffers::Verifier v((uint8_t*)bytes.data(), bytes.size());
+void ClientT::kill() {
+    emit close_requested("Killing ClientT");
+}
 
-            if (!noodles::VerifyClientMessagesBuffer(v)) {
-                qCritical() << "Bad message!";
-                return;
-            }
-            qDebug() << "Message verified";
-        }
+void ClientT::on_connection_closed() {
+    // the server may notice a closed connection both ways
+    if (m_finished) return;
 
-        m_messages = noodles::GetClientMessages(m_data_ref.data());
-    }
+    m_finished = true;
+    emit finished();
+}
 
-    ~IncomingMessage() noexcept { }
+void ClientT::send(MessageFrame frame) {
+    m_bytes_counter += frame.size();
+    if (frame.isEmpty()) return;
 
-    noodles::ClientMessages const* get_root() { return m_messages; }
-};
+    emit frame_ready(std::move(frame));
+}
 
 // =============================================================================
 
-ClientT::ClientT(QWebSocket* socket, QObject* parent)
-    : QObject(parent), m_socket(socket) {
-    socket->setParent(this);
-    connect(socket, &QWebSocket::disconnected, this, &ClientT::finished);
 
-    connect(socket, &QWebSocket::textMessageReceived, this, &ClientT::on_text);
-    connect(
-        socket, &QWebSocket::binaryMessageReceived, this, &ClientT::on_binary);
+static ServerOptions options_for_port(quint16 port) {
+    ServerOptions options;
+    options.port = port;
+    return options;
 }
 
-ClientT::~ClientT() {
-    qInfo() << "Client" << m_name << "closed, sent" << m_bytes_counter
-            << "bytes";
-}
+ServerT::ServerT(quint16 port, QObject* parent)
+    : ServerT(options_for_port(port), parent) { }
 
-void ClientT::on_text(QString text) {
-    qWarning() << "Text not supported!" << text;
-}
+ServerT::ServerT(ServerOptions const& options, QObject* parent)
+    : QObject(parent),
+      m_options(options),
+      m_builder_pool(std::make_shared<BuilderPool>()) {
 
-void ClientT::on_binary(QByteArray array) {
+    m_state = new NoodlesState(this);
 
-    auto ptr = std::make_shared<IncomingMessage>(array);
+    m_broadcast_batch = new MessageBatch(this, this);
 
-    if (!ptr->get_root()) {
-        qCritical() << "Bad message from ClientT" << this;
-        kill();
-        return;
+    connect(m_broadcast_batch,
+            &MessageBatch::data_ready,
+            this,
+            &ServerT::broadcast);
+
+    if (m_options.verify_threads > 0) {
+        m_verify_pool = new QThreadPool(this);
+        m_verify_pool->setMaxThreadCount(int(m_options.verify_threads));
     }
 
+    m_incoming = std::make_shared<IncomingQueue>(this, m_verify_pool);
 
-    emit message_recvd(ptr);
-}
+    if (m_options.io_threads > 0) {
+        // frames and sockets cross threads from here on
+        qRegisterMetaType<MessageFrame>();
+        qRegisterMetaType<qintptr>("qintptr");
 
-void ClientT::set_name(std::string const& s) {
-    m_name = QString::fromStdString(s);
-    qDebug() << "Identifying ClientT" << m_socket << "as" << m_name;
-}
+        std::vector<IOWorker*> workers;
 
-void ClientT::kill() {
-    m_socket->close(QWebSocketProtocol::CloseCodeBadOperation,
-                    "Killing ClientT");
-}
+        for (unsigned i = 0; i < m_options.io_threads; i++) {
+            auto* thread = new QThread(this);
+            auto* worker = new IOWorker(m_incoming, m_options);
 
-void ClientT::send(QByteArray data) {
-    m_bytes_counter += data.size();
-    if (data.isEmpty()) return;
+            worker->moveToThread(thread);
 
-    m_socket->sendBinaryMessage(data);
-}
+            connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+            connect(worker,
+                    &IOWorker::connection_ready,
+                    this,
+                    &ServerT::on_new_client);
 
-// =============================================================================
+            thread->start();
+
+            m_io_threads.push_back(thread);
+            workers.push_back(worker);
+        }
 
+        m_listener = new IOListener(std::move(workers), this);
 
-ServerT::ServerT(quint16 port, QObject* parent) : QObject(parent) {
+        m_listener->listen(QHostAddress::Any, m_options.port);
 
-    m_state = new NoodlesState(this);
+        return;
+    }
 
     m_socket_server = new QWebSocketServer(QStringLiteral("Noodles Server"),
                                            QWebSocketServer::NonSecureMode,
                                            this);
 
-    bool is_listening = m_socket_server->listen(QHostAddress::Any, port);
+    bool is_listening =
+        m_socket_server->listen(QHostAddress::Any, m_options.port);
 
     if (!is_listening) return;
 
@@ -117,37 +175,134 @@ ServerT::ServerT(quint16 port, QObject* parent) : QObject(parent) {
             &ServerT::on_new_connection);
 }
 
+ServerT::~ServerT() {
+    // connections on I/O threads are deleted as their threads finish
+    for (QThread* thread : m_io_threads) {
+        thread->quit();
+        thread->wait();
+    }
+
+    // nothing submits to the pool anymore
+    if (m_verify_pool) m_verify_pool->waitForDone();
+
+    // components call back into us as they are destroyed, so the document
+    // goes while we are still whole
+    delete m_state;
+    m_state = nullptr;
+
+    // lists are destroyed after us, and must not call back
+    for (auto* list : m_dirty_lists) {
+        list->m_dirty_registered = false;
+    }
+
+    m_dirty_lists.clear();
+
+    qInfo() << "Server broadcast" << m_broadcast_batch->frame_count()
+            << "frames," << m_broadcast_batch->byte_count() << "bytes, copied"
+            << m_broadcast_batch->bytes_copied() << "bytes while encoding,"
+            << m_builder_pool->created_count() << "builders";
+}
+
 NoodlesState* ServerT::state() {
     return m_state;
 }
 
-std::unique_ptr<Writer> ServerT::get_broadcast_writer() {
-    auto p = std::make_unique<Writer>();
+ServerOptions const& ServerT::options() const {
+    return m_options;
+}
+
+Writer ServerT::get_broadcast_writer() {
+    return Writer(*m_broadcast_batch);
+}
+
+Writer ServerT::get_single_client_writer(ClientT& c) {
+    // these are replies, and a client should see the effects of its request
+    // first. done before the writer exists, as it may flush the batch.
+    write_dirty_lists();
+
+    return Writer(c.batch());
+}
+
+Writer ServerT::get_table_subscribers_writer(TableT& t) {
+    return Writer(t.subscriber_batch());
+}
+
+std::shared_ptr<BuilderPool> const& ServerT::builder_pool() const {
+    return m_builder_pool;
+}
+
+MessageBatch& ServerT::broadcast_batch() {
+    return *m_broadcast_batch;
+}
+
+void ServerT::on_batch_append(MessageBatch& b) {
+    if (m_open_batch and m_open_batch != &b) {
+        // messages for different destinations may depend on each other, so
+        // anything still waiting goes out first to preserve the order.
+        m_open_batch->flush();
+    }
+
+    m_open_batch = &b;
+
+    if (b.pending_bytes() >= m_options.max_frame_size) {
+        b.flush();
+        return;
+    }
+
+    schedule_flush();
+}
+
+void ServerT::add_dirty_list(ComponentListRock* list) {
+    m_dirty_lists.push_back(list);
 
-    connect(p.get(), &Writer::data_ready, this, &ServerT::broadcast);
+    schedule_flush();
+}
+
+void ServerT::forget_dirty_list(ComponentListRock* list) {
+    std::erase(m_dirty_lists, list);
+}
+
+void ServerT::schedule_flush() {
+    if (m_flush_scheduled) return;
 
-    return p;
+    m_flush_scheduled = true;
+    QTimer::singleShot(0, this, &ServerT::flush_batches);
 }
 
-std::unique_ptr<Writer> ServerT::get_single_client_writer(ClientT& c) {
-    auto p = std::make_unique<Writer>();
+void ServerT::write_dirty_lists() {
+    // lists take writers to write their updates, which would come back here
+    if (m_writing_dirty) return;
 
-    connect(p.get(), &Writer::data_ready, &c, &ClientT::send);
+    m_writing_dirty = true;
 
-    return p;
+    // writing an update can mark more components dirty
+    while (!m_dirty_lists.empty()) {
+        auto dirty = std::move(m_dirty_lists);
+        m_dirty_lists.clear();
+
+        for (auto* list : dirty) {
+            list->write_dirty();
+        }
+    }
+
+    m_writing_dirty = false;
 }
 
-std::unique_ptr<Writer> ServerT::get_table_subscribers_writer(TableT& t) {
-    auto p = std::make_unique<Writer>();
+void ServerT::flush_batches() {
+    // cleared first, so that anything appended from here on schedules a new
+    // flush rather than being left behind
+    m_flush_scheduled = false;
 
-    connect(p.get(), &Writer::data_ready, &t, &TableT::send_data);
+    // merged component updates go out with everything else
+    write_dirty_lists();
 
-    return p;
+    if (m_open_batch) m_open_batch->flush();
 }
 
-void ServerT::broadcast(QByteArray ptr) {
+void ServerT::broadcast(MessageFrame frame) {
+    // every client shares the same frame
     for (ClientT* c : m_connected_clients) {
-        c->send(ptr);
+        if (c->is_introduced()) c->send(frame);
     }
 }
 
@@ -155,14 +310,25 @@ void ServerT::broadcast(QByteArray ptr) {
 void ServerT::on_new_connection() {
     QWebSocket* socket = m_socket_server->nextPendingConnection();
 
-    ClientT* client = new ClientT(socket, this);
+    on_new_client(new ClientConnection(socket, m_incoming, m_options, this));
+}
+
+void ServerT::on_new_client(ClientConnection* connection) {
+    // null if the connection was made on this thread
+    auto* worker = qobject_cast<IOWorker*>(sender());
 
-    qDebug() << Q_FUNC_INFO << client;
+    ClientT* client = new ClientT(connection, worker, this);
+
+    qCDebug(log_server) << Q_FUNC_INFO << client;
 
     connect(client, &ClientT::finished, this, &ServerT::on_client_done);
-    connect(client, &ClientT::message_recvd, this, &ServerT::on_client_message);
 
-    m_connected_clients.insert(client);
+    m_connected_clients.insert(client->id(), client);
+
+    // a connection that closed before the client was listening has nobody to
+    // tell. closed() is emitted after the flag is set, so one of the two
+    // always reaches the client.
+    if (connection->is_closed()) client->on_connection_closed();
 }
 
 void ServerT::on_client_done() {
@@ -170,9 +336,9 @@ void ServerT::on_client_done() {
 
     if (!c) return;
 
-    qDebug() << Q_FUNC_INFO << c;
+    qCDebug(log_server) << Q_FUNC_INFO << c;
 
-    m_connected_clients.remove(c);
+    m_connected_clients.remove(c->id());
 
     c->deleteLater();
 }
@@ -184,19 +350,9 @@ class MessageHandler {
     NoodlesState& get_state() { return *(m_server->state()); }
     DocumentT&    get_document() { return *get_state().document(); }
 
-    template <class List>
-    void dump_list(List& l) {
-        l.for_all([this](auto& item) {
-            auto w = m_server->get_single_client_writer(m_client);
-
-            item.write_new_to(*w);
-            // TODO: Pack into a single message!
-        });
-    }
-
     void handle_introduction(noodles::IntroductionMessage const* m) {
         if (!m) return;
-        qDebug() << Q_FUNC_INFO;
+        qCDebug(log_message) << Q_FUNC_INFO;
 
         m_client.set_name(m->client_name()->str());
 
@@ -209,18 +365,34 @@ class MessageHandler {
 
         auto& d = get_document();
 
-        dump_list(d.method_list());
-        dump_list(d.signal_list());
-        dump_list(d.light_list());
-        dump_list(d.buffer_list());
-        dump_list(d.tex_list());
-        dump_list(d.mat_list());
-        dump_list(d.mesh_list());
-        dump_list(d.table_list());
-        dump_list(d.obj_list());
+        // each list keeps its creation messages encoded, so this mostly
+        // shares frames that were built for earlier clients.
+        std::vector<MessageFrame> frames;
+
+        d.method_list().write_snapshot_to(frames);
+        d.signal_list().write_snapshot_to(frames);
+        d.light_list().write_snapshot_to(frames);
+        d.buffer_list().write_snapshot_to(frames);
+        d.tex_list().write_snapshot_to(frames);
+        d.mat_list().write_snapshot_to(frames);
+        d.mesh_list().write_snapshot_to(frames);
+        d.table_list().write_snapshot_to(frames);
+        d.obj_list().write_snapshot_to(frames);
+
+        // anything queued before this point has to arrive first. this client
+        // is left out of the broadcasts, as the snapshot already includes
+        // them, and pending updates would name components it has not seen.
+        m_server->flush_batches();
+
+        for (auto const& frame : frames) {
+            m_client.send(frame);
+        }
+
+        m_client.set_introduced();
 
         auto w = m_server->get_single_client_writer(m_client);
-        get_document().write_refresh(*w);
+
+        d.write_refresh(w);
     }
 
 
@@ -230,9 +402,9 @@ class MessageHandler {
         auto w = m_server->get_single_client_writer(m_client);
 
         auto x =
-            noodles::CreateMethodReplyDirect(*w, id.c_str(), write_to(var, *w));
+            noodles::CreateMethodReplyDirect(w, id.c_str(), write_to(var, w));
 
-        w->complete_message(x);
+        w.complete_message(x);
     }
 
     void send_method_error_reply(std::string const& id,
@@ -242,9 +414,9 @@ class MessageHandler {
         auto w = m_server->get_single_client_writer(m_client);
 
         auto x =
-            noodles::CreateMethodReplyDirect(*w, id.c_str(), 0, view.c_str());
+            noodles::CreateMethodReplyDirect(w, id.c_str(), 0, view.c_str());
 
-        w->complete_message(x);
+        w.complete_message(x);
     }
 
     void send_table_reply(std::string const& id,
@@ -255,32 +427,34 @@ class MessageHandler {
 
         if (id.empty()) return;
 
-        auto w = exclusive ? m_server->get_single_client_writer(m_client)
-                           : m_server->get_table_subscribers_writer(table);
+        auto& batch =
+            exclusive ? m_client.batch() : table.subscriber_batch();
+
+        Writer w(batch);
 
         flatbuffers::Offset<noodles::MethodReply> x;
 
         if (var) {
             x = noodles::CreateMethodReplyDirect(
-                *w, id.c_str(), write_to(*var, *w));
+                w, id.c_str(), write_to(*var, w));
         } else {
             x = noodles::CreateMethodReplyDirect(
-                *w, id.c_str(), 0, err->c_str());
+                w, id.c_str(), 0, err->c_str());
         }
 
-        w->complete_message(x);
+        w.complete_message(x);
     }
 
     void handle_invoke(noodles::MethodInvokeMessage const* message) {
         if (!message) return;
-        qDebug() << Q_FUNC_INFO;
+        qCDebug(log_message) << Q_FUNC_INFO;
 
         MethodContext             context;
         AttachedMethodList const* target_list = nullptr;
         bool                      is_table    = false;
 
         if (message->on_object()) {
-            qDebug() << "INVOKE on obj";
+            qCDebug(log_message) << "INVOKE on obj";
 
             ObjectID source = convert_id(*message->on_object());
 
@@ -292,7 +466,7 @@ class MessageHandler {
             }
 
         } else if (message->on_table()) {
-            qDebug() << "INVOKE on table";
+            qCDebug(log_message) << "INVOKE on table";
 
             TableID source = convert_id(*message->on_table());
 
@@ -305,7 +479,7 @@ class MessageHandler {
             }
 
         } else {
-            qDebug() << "INVOKE on doc";
+            qCDebug(log_message) << "INVOKE on doc";
             target_list = &(get_document().att_method_list());
         }
 
@@ -340,7 +514,8 @@ class MessageHandler {
             return;
         }
 
-        qDebug() << "METHOD ID" << method_id.id_slot << method_id.id_gen;
+        qCDebug(log_message)
+            << "METHOD ID" << method_id.id_slot << method_id.id_gen;
 
         auto* method = target_list->find(method_id);
 
@@ -386,8 +561,9 @@ class MessageHandler {
             err_str = exp.reason();
         }
 
-        qDebug() << "Method Done" << ret_data.dump_string().c_str()
-                 << err_str.c_str();
+        // only formatted if the category is enabled
+        qCDebug(log_message) << "Method Done" << ret_data.dump_string().c_str()
+                             << err_str.c_str();
 
         if (is_table) {
             auto this_tbl = context.get_table();
@@ -410,7 +586,7 @@ class MessageHandler {
 
     void handle_refresh(::noodles::AssetRefreshMessage const* message) {
         if (!message) return;
-        qDebug() << Q_FUNC_INFO;
+        qCDebug(log_message) << Q_FUNC_INFO;
 
         auto buffer_list = message->for_buffers();
 
@@ -426,7 +602,7 @@ class MessageHandler {
 
             auto w = m_server->get_single_client_writer(m_client);
 
-            buffer_ptr->write_refresh_to(*w);
+            buffer_ptr->write_refresh_to(w);
         }
     }
 
@@ -467,18 +643,22 @@ public:
 };
 
 
-void ServerT::on_client_message(std::shared_ptr<IncomingMessage> ptr) {
-
-    assert(ptr);
+void ServerT::drain_incoming() {
+    m_incoming->drain([this](IncomingEnvelope&& envelope) {
+        ClientT* c = m_connected_clients.value(envelope.client_id);
 
-    ClientT* c = qobject_cast<ClientT*>(sender());
-    qDebug() << Q_FUNC_INFO << c;
+        // the client may have gone in the meantime
+        if (!c) return;
 
-    if (!c) return;
+        if (!envelope.message) {
+            c->kill();
+            return;
+        }
 
-    MessageHandler handler(this, *c);
+        MessageHandler handler(this, *c);
 
-    handler.handle(*ptr);
+        handler.handle(*envelope.message);
+    });
 }
 
 } // namespace noo
@@ -2,52 +2,82 @@
 #define NOODLESSERVER_H
 
 #include "include/noo_id.h"
+#include "include/noo_server_interface.h"
+#include "messageframe.h"
 
+#include <QHash>
 #include <QObject>
-#include <QSet>
+#include <QPointer>
 
 #include <unordered_set>
+#include <vector>
 
+class QThread;
+class QThreadPool;
 class QWebSocketServer;
-class QWebSocket;
 
 namespace noo {
 
 class Writer;
+class MessageBatch;
+class BuilderPool;
 class NoodlesState;
 class TableT;
 class DocumentT;
 
-class IncomingMessage;
+class ComponentListRock;
+class ClientConnection;
+class IncomingQueue;
+class IOListener;
+class IOWorker;
 
 // =============================================================================
 
 class ClientT : public QObject {
     Q_OBJECT
 
-    QString     m_name;
-    QWebSocket* m_socket;
+    QString m_name;
+
+    // the connection may live on another thread; we only talk to it through
+    // signals. if it does, the worker owns it and deletes it for us.
+    ClientConnection*  m_connection;
+    QPointer<IOWorker> m_worker;
+    quint64            m_id;
+
+    bool m_finished = false;
+
+    // broadcasts are only sent once the client has the initial state
+    bool m_introduced = false;
+
+    MessageBatch* m_batch;
 
     size_t m_bytes_counter = 0;
 
 public:
-    ClientT(QWebSocket*, QObject*);
+    /// If the connection belongs to an I/O worker, it must be given
+    ClientT(ClientConnection*, IOWorker*, ServerT*);
     ~ClientT();
 
+    quint64 id() const;
+
     void set_name(std::string const&);
 
+    MessageBatch& batch();
+
+    bool is_introduced() const { return m_introduced; }
+    void set_introduced() { m_introduced = true; }
+
     void kill();
 
 public slots:
-    void send(QByteArray);
-
-private slots:
-    void on_text(QString);
-    void on_binary(QByteArray);
+    void send(MessageFrame);
+    void on_connection_closed();
 
 signals:
     void finished();
-    void message_recvd(std::shared_ptr<IncomingMessage>);
+
+    void frame_ready(MessageFrame);
+    void close_requested(QString);
 };
 
 // =============================================================================
@@ -55,31 +85,78 @@ signals:
 class ServerT : public QObject {
     Q_OBJECT
 
+    ServerOptions m_options;
+
+    std::shared_ptr<BuilderPool> m_builder_pool;
+
     NoodlesState* m_state;
 
-    QWebSocketServer* m_socket_server;
+    QWebSocketServer* m_socket_server = nullptr;
+
+    // threaded mode
+    IOListener*           m_listener = nullptr;
+    std::vector<QThread*> m_io_threads;
 
-    QSet<ClientT*> m_connected_clients;
+    std::shared_ptr<IncomingQueue> m_incoming;
+    QThreadPool*                   m_verify_pool = nullptr;
 
+    QHash<quint64, ClientT*> m_connected_clients;
+
+    MessageBatch* m_broadcast_batch;
+
+    // the batch that last had a message appended
+    QPointer<MessageBatch> m_open_batch;
+    bool                   m_flush_scheduled = false;
+    bool                   m_writing_dirty   = false;
+
+    // lists with components that have updates waiting
+    std::vector<ComponentListRock*> m_dirty_lists;
+
+    void schedule_flush();
 
 public:
     explicit ServerT(quint16 port = 50000, QObject* parent = nullptr);
+    explicit ServerT(ServerOptions const&, QObject* parent = nullptr);
+    ~ServerT();
 
     NoodlesState* state();
 
-    std::unique_ptr<Writer> get_broadcast_writer();
-    std::unique_ptr<Writer> get_single_client_writer(ClientT&);
-    std::unique_ptr<Writer> get_table_subscribers_writer(TableT&);
+    ServerOptions const& options() const;
+
+    Writer get_broadcast_writer();
+    Writer get_single_client_writer(ClientT&);
+    Writer get_table_subscribers_writer(TableT&);
+
+    std::shared_ptr<BuilderPool> const& builder_pool() const;
+
+    MessageBatch& broadcast_batch();
+
+    /// Called by a batch when a message has been added. Internal ONLY.
+    void on_batch_append(MessageBatch&);
+
+    /// Called by component lists with dirty components. Internal ONLY.
+    void add_dirty_list(ComponentListRock*);
+    void forget_dirty_list(ComponentListRock*);
+
+    /// Have dirty lists write their updates now. Called before deletes and
+    /// replies, which may depend on them, so that clients see those updates
+    /// first. Internal ONLY.
+    void write_dirty_lists();
 
 public slots:
-    void broadcast(QByteArray);
+    void broadcast(MessageFrame);
+
+    /// Send all batched messages now.
+    void flush_batches();
+
+    /// Handle messages that have arrived from clients.
+    void drain_incoming();
 
 private slots:
     void on_new_connection();
+    void on_new_client(ClientConnection*);
     void on_client_done();
 
-    void on_client_message(std::shared_ptr<IncomingMessage>);
-
 signals:
 };
 
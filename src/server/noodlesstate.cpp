@@ -2,9 +2,14 @@
 
 #include "noodlesserver.h"
 #include "serialize.h"
+#include "src/common/column_kernels.h"
+#include "src/common/logging.h"
+#include "tablescan.h"
 
 #include <QDebug>
 
+#include <numeric>
+
 namespace noo {
 
 DocumentT::DocumentT(ServerT* s)
@@ -75,7 +80,7 @@ void DocumentT::update(DocumentData const& d, Writer& w) {
 void DocumentT::update(DocumentData const& d) {
     auto w = m_server->get_broadcast_writer();
 
-    update(d, *w);
+    update(d, w);
 }
 
 void DocumentT::write_refresh(Writer& w) {
@@ -109,55 +114,58 @@ static TableTPtr get_table(MethodContext const& context) {
 }
 
 
-static AnyVar table_subscribe(MethodContext const& context,
-                              AnyVarListRef const& /*args*/) {
+/// The reply to a subscription: headers, the rows of a query, and the current
+/// selections
+static AnyVarMap make_table_init(TableSource&             source,
+                                 TableSubscription const& sub,
+                                 TableQuery const&        q) {
+    AnyVarMap return_obj;
 
-    qDebug() << Q_FUNC_INFO;
+    auto headers = source.get_headers();
 
-    auto tbl = get_table(context);
+    if (!sub.filter.columns.empty()) {
+        std::vector<std::string> projected;
 
-    QObject::connect(tbl.get(),
-                     &TableT::send_data,
-                     context.client,
-                     &ClientT::send,
-                     Qt::UniqueConnection);
+        for (auto c : sub.filter.columns) {
+            projected.push_back(headers.at(c));
+        }
 
-    auto& source = *tbl->get_source();
+        headers = std::move(projected);
+    }
 
+    return_obj["columns"] = headers;
 
-    AnyVarMap return_obj;
+    if (sub.columnar) {
+        AnyVar bytes;
+        bytes.emplace<std::vector<std::byte>>(encode_columnar(q));
 
-    return_obj["columns"] = source.get_headers();
+        return_obj["columnar"] = std::move(bytes);
 
-    auto q = source.get_all_data();
+    } else {
+        std::vector<int64_t> keys(q.num_rows);
 
-    {
-        std::vector<int64_t> keys(q->num_rows);
-
-        q->get_keys_to(keys);
+        q.get_keys_to(keys);
 
         return_obj["keys"] = std::move(keys);
-    }
 
-    {
-        AnyVarList lv(q->num_cols);
+        AnyVarList lv(q.num_cols);
 
         for (size_t ci = 0; ci < lv.size(); ci++) {
-            if (q->is_column_string(ci)) {
-                AnyVarList data(q->num_rows);
+            if (q.is_column_string(ci)) {
+                AnyVarList data(q.num_rows);
 
                 for (size_t ri = 0; ri < data.size(); ri++) {
                     std::string_view view;
-                    q->get_cell_to(ci, ri, view);
+                    q.get_cell_to(ci, ri, view);
                     data[ri] = std::string(view);
                 }
 
                 lv[ci] = std::move(data);
 
             } else {
-                std::vector<double> data(q->num_rows);
+                std::vector<double> data(q.num_rows);
 
-                q->get_reals_to(ci, data);
+                q.get_reals_to(ci, data);
 
                 lv[ci] = std::move(data);
             }
@@ -186,6 +194,372 @@ static AnyVar table_subscribe(MethodContext const& context,
     return return_obj;
 }
 
+static size_t find_table_column(TableSource const& source,
+                                AnyVarRef const&   name) {
+    auto const& columns = source.get_columns();
+
+    auto const n = name.to_string();
+
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].name == n) return i;
+    }
+
+    throw MethodException(MethodException::CLIENT, "Unknown table column.");
+}
+
+/// Read a filter: a map with a list of column names, and a list of
+/// predicates
+static TableFilter read_table_filter(TableSource const& source,
+                                     AnyVarRef const&   arg) {
+    TableFilter ret;
+
+    auto filter = arg.to_map();
+
+    auto const& columns = source.get_columns();
+
+    if (filter.count("columns")) {
+        filter["columns"].to_vector().for_each(
+            [&](auto, AnyVarRef const& r) {
+                ret.columns.push_back(find_table_column(source, r));
+            });
+    }
+
+    if (filter.count("where")) {
+        filter["where"].to_vector().for_each([&](auto, AnyVarRef const& r) {
+            auto predicate = r.to_map();
+
+            auto const c = find_table_column(source, predicate["column"]);
+
+            if (predicate.count("equals")) {
+                if (!columns[c].is_string()) {
+                    throw MethodException(
+                        MethodException::CLIENT,
+                        "Equality predicates need a string column.");
+                }
+
+                ret.equals.push_back(
+                    { c, std::string(predicate["equals"].to_string()) });
+                return;
+            }
+
+            if (columns[c].is_string()) {
+                throw MethodException(MethodException::CLIENT,
+                                      "Range predicates need a real column.");
+            }
+
+            auto bound = [&predicate](char const* k, double fallback) {
+                if (!predicate.count(k)) return fallback;
+
+                auto v = predicate[k];
+                return v.has_int() ? double(v.to_int()) : v.to_real();
+            };
+
+            auto const inf = std::numeric_limits<double>::infinity();
+
+            ret.ranges.push_back({ c, bound("min", -inf), bound("max", inf) });
+        });
+    }
+
+    return ret;
+}
+
+/// Read the optional encoding and filter arguments of a subscription
+static TableSubscription read_subscription(TableSource const&   source,
+                                           AnyVarListRef const& args,
+                                           size_t               at) {
+    TableSubscription ret;
+
+    ret.columnar = args.size() > at and args[at].to_string() == "columnar";
+
+    if (args.size() > at + 1) {
+        ret.filter = read_table_filter(source, args[at + 1]);
+    }
+
+    return ret;
+}
+
+static AnyVar table_subscribe(MethodContext const& context,
+                              AnyVarListRef const& args) {
+
+    qCDebug(log_component) << Q_FUNC_INFO;
+
+    auto tbl = get_table(context);
+
+    auto& source = *tbl->get_source();
+
+    auto sub = read_subscription(source, args, 0);
+
+    auto q = tbl->add_subscriber(context.client, source.get_all_data(), sub);
+
+    return make_table_init(source, sub, *q);
+}
+
+static AnyVar table_subscribe_window(MethodContext const& context,
+                                     AnyVarListRef const& args) {
+
+    qCDebug(log_component) << Q_FUNC_INFO;
+
+    auto tbl = get_table(context);
+
+    if (args.size() < 2) {
+        throw MethodException(MethodException::CLIENT,
+                              "Need a row offset and a row limit.");
+    }
+
+    auto const offset = args[0].to_int();
+    auto const limit  = args[1].to_int();
+
+    if (offset < 0 or limit <= 0) {
+        throw MethodException(MethodException::CLIENT,
+                              "Offset must not be negative, and limit must be "
+                              "positive.");
+    }
+
+    auto& source = *tbl->get_source();
+
+    auto sub = read_subscription(source, args, 2);
+
+    auto q = source.get_row_range(offset, limit);
+
+    // rows stay in key order, so the page is pinned to its range of keys. a
+    // page that reaches the end of the table stays open, so appended rows
+    // show up in it.
+
+    auto const& all_keys = source.get_row_to_key_map();
+
+    std::vector<int64_t> keys(q->num_rows);
+    q->get_keys_to(keys);
+
+    auto& window = sub.window.emplace();
+
+    if (!keys.empty()) {
+        window.first_key = keys.front();
+    } else if (!all_keys.empty()) {
+        window.first_key = all_keys.back() + 1;
+    }
+
+    if (size_t(offset) + q->num_rows < all_keys.size()) {
+        window.last_key = keys.back();
+    }
+
+    auto ret = make_table_init(
+        source, sub, *tbl->add_subscriber(context.client, q, sub));
+
+    ret["total_rows"] = all_keys.size();
+
+    return ret;
+}
+
+/// Headers, keys, and data of some rows of a source, in the given order
+static AnyVar make_rows_reply(TableSource const&         source,
+                              std::span<size_t const>    rows,
+                              std::vector<size_t> const& columns) {
+    auto const& all_columns = source.get_columns();
+    auto const& row_keys    = source.get_row_to_key_map();
+
+    std::vector<size_t> picked = columns;
+
+    if (picked.empty()) {
+        picked.resize(all_columns.size());
+        std::iota(picked.begin(), picked.end(), size_t(0));
+    }
+
+    AnyVarMap return_obj;
+
+    {
+        std::vector<std::string> headers;
+
+        for (auto c : picked) {
+            headers.push_back(all_columns[c].name);
+        }
+
+        return_obj["columns"] = headers;
+    }
+
+    {
+        std::vector<int64_t> keys;
+        keys.reserve(rows.size());
+
+        for (auto r : rows) {
+            keys.push_back(row_keys.at(r));
+        }
+
+        return_obj["keys"] = std::move(keys);
+    }
+
+    AnyVarList lv;
+
+    for (auto c : picked) {
+        auto const& column = all_columns[c];
+
+        if (column.is_string()) {
+            auto const values = column.as_string();
+
+            AnyVarList data;
+            data.reserve(rows.size());
+
+            for (auto r : rows) {
+                data.emplace_back(std::string_view(values[r]));
+            }
+
+            lv.emplace_back(std::move(data));
+
+        } else {
+            std::vector<double> data(rows.size());
+
+            column_gather(column.as_doubles(), rows, data);
+
+            lv.emplace_back(std::move(data));
+        }
+    }
+
+    return_obj["data"] = std::move(lv);
+
+    return return_obj;
+}
+
+/// Rows of a source that pass the filter argument at the given position, if
+/// there is one
+static std::vector<size_t> read_and_scan(TableSource&         source,
+                                         AnyVarListRef const& args,
+                                         size_t               at,
+                                         TableFilter&         filter) {
+    // pending deletions would otherwise show up as rows
+    source.compact();
+
+    if (args.size() > at) filter = read_table_filter(source, args[at]);
+
+    return flagged_rows(scan_rows(source, filter));
+}
+
+static AnyVar table_select(MethodContext const& context,
+                           AnyVarListRef const& args) {
+    auto tbl = get_table(context);
+
+    auto& source = *tbl->get_source();
+
+    TableFilter filter;
+
+    auto rows = read_and_scan(source, args, 0, filter);
+
+    return make_rows_reply(source, rows, filter.columns);
+}
+
+static AnyVar table_top_k(MethodContext const& context,
+                          AnyVarListRef const& args) {
+    auto tbl = get_table(context);
+
+    auto& source = *tbl->get_source();
+
+    if (args.size() < 2) {
+        throw MethodException(MethodException::CLIENT,
+                              "Need a column name and a row count.");
+    }
+
+    auto const column = find_table_column(source, args[0]);
+    auto const k      = args[1].to_int();
+
+    if (k < 0) {
+        throw MethodException(MethodException::CLIENT,
+                              "Row count must not be negative.");
+    }
+
+    bool descending = true;
+
+    if (args.size() > 2) {
+        BoolArg b(args[2]);
+        if (b) descending = *b;
+    }
+
+    TableFilter filter;
+
+    auto rows = read_and_scan(source, args, 3, filter);
+
+    keep_top_k(source, rows, column, k, descending);
+
+    return make_rows_reply(source, rows, filter.columns);
+}
+
+static AnyVar table_group_by(MethodContext const& context,
+                             AnyVarListRef const& args) {
+    auto tbl = get_table(context);
+
+    auto& source = *tbl->get_source();
+
+    if (args.size() < 1) {
+        throw MethodException(MethodException::CLIENT,
+                              "Need a column to group by.");
+    }
+
+    auto const  group_column = find_table_column(source, args[0]);
+    auto const& columns      = source.get_columns();
+
+    std::vector<size_t> value_columns;
+
+    if (args.size() > 1) {
+        args[1].to_vector().for_each([&](auto, AnyVarRef const& r) {
+            auto c = find_table_column(source, r);
+
+            if (columns[c].is_string()) {
+                throw MethodException(MethodException::CLIENT,
+                                      "Can only aggregate real columns.");
+            }
+
+            value_columns.push_back(c);
+        });
+    }
+
+    TableFilter filter;
+
+    auto rows = read_and_scan(source, args, 2, filter);
+
+    auto summary = group_rows(source, rows, group_column, value_columns);
+
+    AnyVarMap return_obj;
+
+    auto const& group = columns[group_column];
+
+    if (group.is_string()) {
+        AnyVarList groups;
+
+        for (auto r : summary.group_rows) {
+            groups.emplace_back(std::string_view(group.as_string()[r]));
+        }
+
+        return_obj["groups"] = std::move(groups);
+
+    } else {
+        std::vector<double> groups;
+
+        for (auto r : summary.group_rows) {
+            groups.push_back(group.as_doubles()[r]);
+        }
+
+        return_obj["groups"] = std::move(groups);
+    }
+
+    return_obj["counts"] = std::move(summary.counts);
+
+    AnyVarMap stats;
+
+    for (size_t i = 0; i < value_columns.size(); i++) {
+        auto& s = summary.stats[i];
+
+        AnyVarMap column_stats;
+
+        column_stats["sum"]  = std::move(s.sum);
+        column_stats["min"]  = std::move(s.min);
+        column_stats["max"]  = std::move(s.max);
+        column_stats["mean"] = std::move(s.mean);
+
+        stats[columns[value_columns[i]].name] = std::move(column_stats);
+    }
+
+    return_obj["stats"] = std::move(stats);
+
+    return return_obj;
+}
+
 static auto get_builtin(TableT* tbl, BuiltinSignals b) {
     auto* server = server_from_component(tbl);
     return server->state()->document()->get_builtin(b);
@@ -246,7 +620,7 @@ static AnyVar table_data_clear(MethodContext const& context) {
 static AnyVar table_update_selection(MethodContext const& context,
                                      std::string_view     selection_id,
                                      SelectionRef         selection_ref) {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(log_component) << Q_FUNC_INFO;
 
     auto tbl = get_table(context);
 
@@ -480,8 +854,19 @@ void DocumentT::build_table_methods() {
 
     {
         MethodData d;
-        d.method_name          = "tbl_subscribe"sv;
-        d.documentation        = "Subscribe to this table's signals"sv;
+        d.method_name   = "tbl_subscribe"sv;
+        d.documentation = "Subscribe to this table's signals"sv;
+        d.argument_documentation = {
+            { "[encoding]",
+              "Optional. Pass \"columnar\" to get data as a columnar table "
+              "block, and updates through tbl_updated_columnar." },
+            { "[filter]",
+              "Optional. A map with \"columns\", a list of column names to "
+              "send, and \"where\", a list of predicates that rows must all "
+              "pass. A predicate is a map with a \"column\" name and either "
+              "\"min\" and/or \"max\" for real columns, or \"equals\" for "
+              "string columns." },
+        };
         d.return_documentation = "A table initialization object."sv;
         d.code                 = table_subscribe;
 
@@ -489,6 +874,27 @@ void DocumentT::build_table_methods() {
             create_method(this, d);
     }
 
+    {
+        MethodData d;
+        d.method_name = "tbl_subscribe_window"sv;
+        d.documentation =
+            "Subscribe to a window of this table's rows. Signals are only "
+            "sent for rows in the window. Calling again moves the window."sv;
+        d.argument_documentation = {
+            { "int", "Row offset of the window" },
+            { "int", "Maximum number of rows in the window" },
+            { "[encoding]", "Optional. As for tbl_subscribe." },
+            { "[filter]", "Optional. As for tbl_subscribe." },
+        };
+        d.return_documentation =
+            "A table initialization object for the window, with total_rows "
+            "added."sv;
+        d.code = table_subscribe_window;
+
+        m_builtin_methods[BuiltinMethods::TABLE_SUBSCRIBE_WINDOW] =
+            create_method(this, d);
+    }
+
     {
         MethodData d;
         d.method_name = "tbl_insert"sv;
@@ -543,7 +949,9 @@ void DocumentT::build_table_methods() {
                 "string",
                 "Name of the selection to update",
             },
-            { "selection_data", "A SelectionObject" },
+            { "selection_data",
+              "A SelectionObject. A RowSet, in binary form, may be given as "
+              "row_set" },
         };
         d.return_documentation = "None"sv;
         d.set_code(table_update_selection);
@@ -552,6 +960,61 @@ void DocumentT::build_table_methods() {
             create_method(this, d);
     }
 
+    {
+        MethodData d;
+        d.method_name   = "tbl_select"sv;
+        d.documentation = "Fetch the rows that pass a filter."sv;
+        d.argument_documentation = {
+            { "[filter]", "Optional. As for tbl_subscribe." },
+        };
+        d.return_documentation =
+            "A map with the column names, and the keys and data of the rows."sv;
+        d.code = table_select;
+
+        m_builtin_methods[BuiltinMethods::TABLE_SELECT] =
+            create_method(this, d);
+    }
+
+    {
+        MethodData d;
+        d.method_name = "tbl_top_k"sv;
+        d.documentation =
+            "Fetch the rows with the largest, or smallest, values in a "
+            "column."sv;
+        d.argument_documentation = {
+            { "string", "Column to sort by" },
+            { "int", "Number of rows" },
+            { "[bool]", "Optional. Largest first, the default, if true." },
+            { "[filter]", "Optional. As for tbl_subscribe." },
+        };
+        d.return_documentation = "As for tbl_select, in sorted order."sv;
+        d.code                 = table_top_k;
+
+        m_builtin_methods[BuiltinMethods::TABLE_TOP_K] =
+            create_method(this, d);
+    }
+
+    {
+        MethodData d;
+        d.method_name = "tbl_group_by"sv;
+        d.documentation =
+            "Group rows by the value of a column, and aggregate other "
+            "columns."sv;
+        d.argument_documentation = {
+            { "string", "Column to group by" },
+            { "[string]", "Optional. Real columns to aggregate" },
+            { "[filter]", "Optional. As for tbl_subscribe." },
+        };
+        d.return_documentation =
+            "A map with the group values, the row count of each group, and "
+            "for each aggregated column, a map of sum, min, max, and mean "
+            "lists."sv;
+        d.code = table_group_by;
+
+        m_builtin_methods[BuiltinMethods::TABLE_GROUP_BY] =
+            create_method(this, d);
+    }
+
     {
         MethodData d;
         d.method_name          = "tbl_clear"sv;
@@ -765,6 +1228,17 @@ void DocumentT::build_table_signals() {
             create_signal(this, d);
     }
 
+    {
+        SignalData d;
+        d.signal_name = "tbl_updated_columnar"sv;
+        d.documentation =
+            "Rows have been inserted or updated in the table, sent to columnar subscribers"sv;
+        std::string args[] = { "Columnar table block" };
+
+        m_builtin_signals[BuiltinSignals::TABLE_SIG_DATA_UPDATED_COLUMNAR] =
+            create_signal(this, d);
+    }
+
     {
         SignalData d;
         d.signal_name      = "tbl_rows_removed"sv;
@@ -781,7 +1255,7 @@ void DocumentT::build_table_signals() {
         d.documentation    = "A selection of the table has changed"sv;
         std::string args[] = {
             "Selection ID",
-            "Selection Object",
+            "A map of the added and removed keys, as RowSets in binary form",
         };
 
         m_builtin_signals[BuiltinSignals::TABLE_SIG_SELECTION_CHANGED] =
@@ -20,11 +20,15 @@ namespace noo {
 
 enum class BuiltinMethods {
     TABLE_SUBSCRIBE,
+    TABLE_SUBSCRIBE_WINDOW,
     TABLE_INSERT,
     TABLE_UPDATE,
     TABLE_REMOVE,
     TABLE_CLEAR,
     TABLE_UPDATE_SELECTION,
+    TABLE_SELECT,
+    TABLE_TOP_K,
+    TABLE_GROUP_BY,
 
     OBJ_ACTIVATE,
     OBJ_GET_ACTIVATE_CHOICES,
@@ -48,6 +52,7 @@ enum class BuiltinSignals {
     TABLE_SIG_RESET,
     TABLE_SIG_ROWS_DELETED,
     TABLE_SIG_DATA_UPDATED,
+    TABLE_SIG_DATA_UPDATED_COLUMNAR,
     TABLE_SIG_SELECTION_CHANGED,
 
     OBJ_SIG_ATT,
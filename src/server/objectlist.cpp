@@ -5,32 +5,60 @@
 #include "serialize.h"
 #include "src/generated/interface_tools.h"
 
+#include <cmath>
+
 namespace noo {
 
-ObjectList::ObjectList(ServerT* s) : ComponentListBase(s) { }
+ObjectList::ObjectList(ServerT* s)
+    : ComponentListBase(s),
+      m_settle_time(s->options().transform_settle_ms) {
+    m_settle_timer.setInterval(m_settle_time);
+
+    QObject::connect(
+        &m_settle_timer, &QTimer::timeout, [this]() { send_settled(); });
+}
 
 ObjectList::~ObjectList() { }
 
+void ObjectList::hold_transform(ObjectID id) {
+    m_held.push_back(id);
+
+    // never restarted by later holds, so one object that keeps moving does
+    // not hold back the others
+    if (!m_settle_timer.isActive()) m_settle_timer.start();
+}
+
+void ObjectList::send_settled() {
+    auto const settled = std::chrono::steady_clock::now() - m_settle_time;
+
+    // objects deleted, or sent, since they were held are dropped
+    std::erase_if(m_held, [this, settled](ObjectID id) {
+        auto* ptr = get_raw(id);
+        return !ptr or ptr->send_held_transform(settled);
+    });
+
+    if (m_held.empty()) m_settle_timer.stop();
+}
+
 // =============================================================================
 
-class ObjectTUpdateHelper {
-public:
-    bool name        = false;
-    bool parent      = false;
-    bool transform   = false;
-    bool material    = false;
-    bool mesh        = false;
-    bool lights      = false;
-    bool tables      = false;
-    bool instances   = false;
-    bool tags        = false;
-    bool method_list = false;
-    bool signal_list = false;
-    bool text        = false;
-};
+void ObjectTUpdateHelper::merge(ObjectTUpdateHelper const& o) {
+    name |= o.name;
+    parent |= o.parent;
+    transform |= o.transform;
+    material |= o.material;
+    mesh |= o.mesh;
+    lights |= o.lights;
+    tables |= o.tables;
+    instances |= o.instances;
+    tags |= o.tags;
+    method_list |= o.method_list;
+    signal_list |= o.signal_list;
+    text |= o.text;
+}
 
 ObjectT::ObjectT(IDType id, ObjectList* host, ObjectData const& d)
-    : ComponentMixin(id, host), m_data(d) {
+    : ComponentMixin(id, host), m_data(d), m_sent_transform(d.transform) {
     m_method_search = m_data.method_list;
     m_signal_search = m_data.signal_list;
 
@@ -176,7 +204,7 @@ void ObjectT::write_new_to(Writer& w) {
         }                                                                      \
     }
 
-void ObjectT::update(ObjectUpdateData& data, Writer& w) {
+ObjectTUpdateHelper ObjectT::apply(ObjectUpdateData& data) {
     ObjectTUpdateHelper update_opts;
 
     CHECK_UPDATE(name)
@@ -195,13 +223,89 @@ void ObjectT::update(ObjectUpdateData& data, Writer& w) {
     if (update_opts.method_list) { m_method_search = m_data.method_list; }
     if (update_opts.signal_list) { m_signal_search = m_data.signal_list; }
 
-    update_common(update_opts, w);
+    m_parent_list->mark_changed(id());
+
+    return update_opts;
+}
+
+void ObjectT::update(ObjectUpdateData& data, Writer& w) {
+    auto opts = apply(data);
+
+    // a held transform goes out with any update
+    opts.transform |= std::exchange(m_transform_held, false);
+
+    // only broadcasts move the deadband baseline; a snapshot for a joining
+    // client is a value the other clients never saw
+    if (opts.transform) m_sent_transform = m_data.transform;
+
+    update_common(opts, w);
 }
 
 void ObjectT::update(ObjectUpdateData& data) {
-    auto w = m_parent_list->new_bcast();
+    m_pending.merge(apply(data));
+
+    m_parent_list->mark_dirty(*this);
+}
+
+void ObjectT::write_dirty_to(Writer& w) {
+    auto opts = std::exchange(m_pending, {});
+
+    opts.transform |= std::exchange(m_transform_held, false);
+
+    if (opts.transform) m_sent_transform = m_data.transform;
+
+    update_common(opts, w);
+}
+
+static bool
+exceeds_deadband(glm::mat4 const& a, glm::mat4 const& b, float deadband) {
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            if (std::abs(a[c][r] - b[c][r]) > deadband) return true;
+        }
+    }
+    return false;
+}
+
+void ObjectT::update_transform(glm::mat4 const& transform) {
+    m_data.transform = transform;
+
+    // new clients get the exact value from the snapshot
+    m_parent_list->mark_changed(id());
+
+    // already going out, with this latest value
+    if (m_pending.transform) return;
+
+    auto const deadband = m_parent_list->server()->options().transform_deadband;
+
+    if (!exceeds_deadband(m_sent_transform, transform, deadband)) {
+        // kept, so the final position of a movement is not lost
+        m_held_at = std::chrono::steady_clock::now();
+
+        if (!std::exchange(m_transform_held, true)) {
+            m_parent_list->hold_transform(id());
+        }
+        return;
+    }
+
+    m_pending.transform = true;
+
+    m_parent_list->mark_dirty(*this);
+}
+
+/// Send a held transform if the object has not moved since the given time.
+/// Returns false if it is still held.
+bool ObjectT::send_held_transform(
+    std::chrono::steady_clock::time_point settled) {
+    if (!m_transform_held) return true;
+
+    if (m_held_at > settled) return false;
+
+    m_pending.transform = true;
+
+    m_parent_list->mark_dirty(*this);
 
-    update(data, *w);
+    return true;
 }
 
 void ObjectT::write_delete_to(Writer& w) {
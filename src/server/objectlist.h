@@ -7,21 +7,63 @@
 #include "include/noo_server_interface.h"
 #include "search_helpers.h"
 
+#include <QTimer>
+
+#include <chrono>
 #include <unordered_set>
 
 namespace noo {
 
 class ObjectList : public ComponentListBase<ObjectList, ObjectID, ObjectT> {
+    // objects whose latest transform was held back by the deadband
+    std::vector<ObjectID> m_held;
+
+    // runs while anything is held, to send objects that have settled
+    QTimer m_settle_timer;
+
+    std::chrono::milliseconds m_settle_time;
+
+    void send_settled();
+
 public:
     ObjectList(ServerT*);
     ~ObjectList();
+
+    /// Send the transform of an object once it stops moving
+    void hold_transform(ObjectID);
 };
 
-class ObjectTUpdateHelper;
+/// Which fields of an object need to be sent
+struct ObjectTUpdateHelper {
+    bool name        = false;
+    bool parent      = false;
+    bool transform   = false;
+    bool material    = false;
+    bool mesh        = false;
+    bool lights      = false;
+    bool tables      = false;
+    bool instances   = false;
+    bool tags        = false;
+    bool method_list = false;
+    bool signal_list = false;
+    bool text        = false;
+
+    void merge(ObjectTUpdateHelper const&);
+};
 
 class ObjectT : public ComponentMixin<ObjectT, ObjectList, ObjectID> {
     ObjectData m_data;
 
+    // what clients were last told, for the transform deadband
+    glm::mat4 m_sent_transform;
+
+    // the transform moved, but not past the deadband
+    bool                                  m_transform_held = false;
+    std::chrono::steady_clock::time_point m_held_at;
+
+    // fields changed since the last update was written
+    ObjectTUpdateHelper m_pending;
+
     AttachedMethodList m_method_search;
     AttachedSignalList m_signal_search;
 
@@ -29,12 +71,17 @@ class ObjectT : public ComponentMixin<ObjectT, ObjectList, ObjectID> {
 
     void update_common(ObjectTUpdateHelper const&, Writer&);
 
+    ObjectTUpdateHelper apply(ObjectUpdateData&);
+
 public:
     ObjectT(IDType, ObjectList*, ObjectData const&);
 
     void write_new_to(Writer&);
     void update(ObjectUpdateData&, Writer&);
     void update(ObjectUpdateData&);
+    void update_transform(glm::mat4 const&);
+    bool send_held_transform(std::chrono::steady_clock::time_point settled);
+    void write_dirty_to(Writer&);
     void write_delete_to(Writer&);
 
 
@@ -0,0 +1,209 @@
+#include "outboundqueue.h"
+
+#include "src/generated/noodles_server_generated.h"
+
+#include <flatbuffers/flatbuffers.h>
+
+#include <unordered_map>
+
+namespace noo {
+
+namespace {
+
+enum class Change { UPDATE, REMOVE, OTHER };
+
+template <class ID>
+uint64_t make_key(noodles::ServerMessageType family, ID const* id) {
+    return (uint64_t(family) << 56) |
+           (uint64_t(id->id_gen() & 0xFFFFFF) << 32) | id->id_slot();
+}
+
+/// Which fields of a table are present; updates only carry what changed.
+uint32_t present_fields(void const* p) {
+    auto const* table = reinterpret_cast<flatbuffers::Table const*>(p);
+
+    uint32_t ret = 0;
+
+    for (uint32_t i = 0; i < 32; i++) {
+        auto field = flatbuffers::voffset_t(4 + 2 * i);
+        if (table->CheckField(field)) ret |= (1u << i);
+    }
+
+    return ret;
+}
+
+template <class T, class Function>
+void visit_as(noodles::ServerMessage const* m,
+              noodles::ServerMessageType   family,
+              Change                       change,
+              Function&                    f) {
+    auto const* p = m->message_as<T>();
+
+    if (!p or !p->id()) {
+        f(Change::OTHER, 0, 0);
+        return;
+    }
+
+    auto fields = change == Change::UPDATE ? present_fields(p) : 0;
+
+    f(change, make_key(family, p->id()), fields);
+}
+
+/// Call f(change, key, fields) for each message in a frame.
+template <class Function>
+void visit_messages(MessageFrame const& frame, Function&& f) {
+    using MT = noodles::ServerMessageType;
+
+    auto const* root = noodles::GetServerMessages(frame.data());
+
+    if (!root->messages()) return;
+
+    for (auto const* m : *root->messages()) {
+        switch (m->message_type()) {
+        case MT::ObjectCreateUpdate:
+            visit_as<noodles::ObjectCreateUpdate>(
+                m, MT::ObjectCreateUpdate, Change::UPDATE, f);
+            break;
+        case MT::ObjectDelete:
+            visit_as<noodles::ObjectDelete>(
+                m, MT::ObjectCreateUpdate, Change::REMOVE, f);
+            break;
+        case MT::LightCreateUpdate:
+            visit_as<noodles::LightCreateUpdate>(
+                m, MT::LightCreateUpdate, Change::UPDATE, f);
+            break;
+        case MT::LightDelete:
+            visit_as<noodles::LightDelete>(
+                m, MT::LightCreateUpdate, Change::REMOVE, f);
+            break;
+        case MT::MaterialCreateUpdate:
+            visit_as<noodles::MaterialCreateUpdate>(
+                m, MT::MaterialCreateUpdate, Change::UPDATE, f);
+            break;
+        case MT::MaterialDelete:
+            visit_as<noodles::MaterialDelete>(
+                m, MT::MaterialCreateUpdate, Change::REMOVE, f);
+            break;
+        default: f(Change::OTHER, 0, 0);
+        }
+    }
+}
+
+} // namespace
+
+void OutboundQueue::scan(Entry& e) {
+    if (e.scanned) return;
+
+    e.scanned     = true;
+    e.conflatable = true;
+
+    visit_messages(e.frame, [&e](Change change, uint64_t key, uint32_t fields) {
+        if (change == Change::UPDATE) {
+            e.updates.push_back({ key, fields });
+        } else {
+            e.conflatable = false;
+        }
+    });
+}
+
+void OutboundQueue::track_delivery(Entry const& e) {
+    // a scanned conflatable frame holds nothing but the updates we kept
+    if (e.scanned and e.conflatable) {
+        for (auto const& u : e.updates) {
+            m_delivered.insert(u.key);
+        }
+        return;
+    }
+
+    visit_messages(e.frame, [this](Change change, uint64_t key, uint32_t) {
+        switch (change) {
+        case Change::UPDATE: m_delivered.insert(key); break;
+        case Change::REMOVE: m_delivered.erase(key); break;
+        case Change::OTHER: break;
+        }
+    });
+}
+
+OutboundQueue::OutboundQueue(size_t conflate_threshold)
+    : m_track_from(conflate_threshold / 2) { }
+
+void OutboundQueue::push(MessageFrame frame) {
+    m_queued_bytes += frame.size();
+    m_frames.push_back({ std::move(frame) });
+
+    if (m_queued_bytes >= m_track_from) m_tracking = true;
+}
+
+MessageFrame OutboundQueue::pop() {
+    Q_ASSERT(!m_frames.empty());
+
+    if (m_tracking) track_delivery(m_frames.front());
+
+    MessageFrame ret = std::move(m_frames.front().frame);
+    m_frames.pop_front();
+
+    m_queued_bytes -= ret.size();
+
+    // the client has caught up. anything delivered before tracking starts
+    // again is treated as unknown, which only means fewer frames are dropped.
+    if (m_frames.empty()) {
+        m_tracking = false;
+        m_delivered.clear();
+    }
+
+    return ret;
+}
+
+size_t OutboundQueue::conflate() {
+    // fields written to each component by frames newer than the one we are
+    // looking at
+    std::unordered_map<uint64_t, uint32_t> later;
+
+    size_t dropped = 0;
+
+    for (auto iter = m_frames.rbegin(); iter != m_frames.rend();) {
+        Entry& e = *iter;
+
+        scan(e);
+
+        bool superseded = e.conflatable;
+
+        for (auto const& u : e.updates) {
+            if (!superseded) break;
+
+            auto const lp = later.find(u.key);
+
+            superseded = m_delivered.count(u.key) and lp != later.end() and
+                         (lp->second & u.fields) == u.fields;
+        }
+
+        for (auto const& u : e.updates) {
+            later[u.key] |= u.fields;
+        }
+
+        if (!superseded) {
+            ++iter;
+            continue;
+        }
+
+        dropped += e.frame.size();
+        m_dropped_frames++;
+
+        iter = decltype(iter)(m_frames.erase(std::next(iter).base()));
+    }
+
+    m_queued_bytes -= dropped;
+    m_dropped_bytes += dropped;
+
+    return dropped;
+}
+
+void OutboundQueue::clear() {
+    m_frames.clear();
+    m_queued_bytes = 0;
+
+    m_tracking = false;
+    m_delivered.clear();
+}
+
+} // namespace noo
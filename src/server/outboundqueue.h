@@ -0,0 +1,81 @@
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include "messageframe.h"
+
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+namespace noo {
+
+///
+/// \brief The OutboundQueue class holds the frames for one client that have
+/// not yet been handed to its socket.
+///
+/// When a client falls behind, the queue can be conflated: frames made up
+/// only of object, light, and material updates that are superseded by later
+/// queued updates to the same components are dropped, as the client will end
+/// up at the same state either way.
+///
+/// Frames are only inspected on their way out once the queue has grown to
+/// half the conflation threshold. Until then, sending costs no decoding.
+///
+class OutboundQueue {
+    struct Update {
+        uint64_t key;
+        uint32_t fields;
+    };
+
+    struct Entry {
+        MessageFrame frame;
+
+        // filled in on the first conflation pass that sees this frame
+        bool                scanned     = false;
+        bool                conflatable = false;
+        std::vector<Update> updates;
+    };
+
+    std::deque<Entry> m_frames;
+
+    size_t m_queued_bytes = 0;
+
+    // start tracking delivered components at this many queued bytes
+    size_t m_track_from;
+    bool   m_tracking = false;
+
+    // components the client has been told about while tracking; updates to
+    // anything else may be creates, and are not dropped. cleared when the
+    // queue drains.
+    std::unordered_set<uint64_t> m_delivered;
+
+    size_t m_dropped_frames = 0;
+    size_t m_dropped_bytes  = 0;
+
+    static void scan(Entry&);
+
+    void track_delivery(Entry const&);
+
+public:
+    explicit OutboundQueue(size_t conflate_threshold);
+
+    void push(MessageFrame);
+
+    /// Remove the oldest frame, to be written to the socket.
+    MessageFrame pop();
+
+    bool   empty() const { return m_frames.empty(); }
+    size_t queued_bytes() const { return m_queued_bytes; }
+
+    /// Drop superseded frames. Returns the number of bytes dropped.
+    size_t conflate();
+
+    void clear();
+
+    size_t dropped_frames() const { return m_dropped_frames; }
+    size_t dropped_bytes() const { return m_dropped_bytes; }
+};
+
+} // namespace noo
+
+#endif // OUTBOUNDQUEUE_H
@@ -3,43 +3,62 @@
 
 #include "methodlist.h"
 
-#include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <unordered_map>
+#include <vector>
 
 namespace noo {
 
+///
+/// \brief The AttachedMethodList class holds the methods attached to a
+/// component, sorted by id so that dispatch is a binary search.
+///
 class AttachedMethodList {
-    // because we dont have heterogeneous lookup yet
-    std::unordered_set<MethodTPtr> m_sptrs;
-    std::unordered_set<MethodT*>   m_ptrs;
+    std::vector<MethodTPtr> m_sptrs;
+
+    static auto key(MethodID id) { return std::pair(id.id_slot, id.id_gen); }
+
+    auto lower_bound(MethodID id) const {
+        return std::lower_bound(
+            m_sptrs.begin(), m_sptrs.end(), id, [](auto const& p, MethodID i) {
+                return key(p->id()) < key(i);
+            });
+    }
 
 public:
     AttachedMethodList() = default;
 
     template <class Iter>
-    AttachedMethodList(Iter first, Iter last) : m_sptrs(first, last) {
+    AttachedMethodList(Iter first, Iter last) {
         for (auto iter = first; iter != last; iter++) {
-            m_ptrs.insert(iter->get());
+            insert(*iter);
         }
     }
 
     void insert(MethodTPtr const& p) {
         assert(p);
-        m_sptrs.insert(p);
-        m_ptrs.insert(p.get());
+
+        auto iter = lower_bound(p->id());
+
+        if (iter != m_sptrs.end() and (*iter)->id() == p->id()) return;
+
+        m_sptrs.insert(iter, p);
     }
 
     MethodT* find(MethodID id) const {
-        // todo FIX THIS
-        for (auto* ptr : m_ptrs) {
-            if (ptr->id() == id) return ptr;
-        }
-        return nullptr;
+        auto iter = lower_bound(id);
+
+        if (iter == m_sptrs.end() or (*iter)->id() != id) return nullptr;
+
+        return iter->get();
     }
 
     template <class T>
     AttachedMethodList& operator=(std::vector<T> const& v) {
         m_sptrs.clear();
-        m_ptrs.clear();
+        m_sptrs.reserve(v.size());
         for (auto const& t : v) {
             insert(t);
         }
@@ -52,40 +71,58 @@ public:
 };
 
 
+///
+/// \brief The AttachedSignalList class holds the signals attached to a
+/// component, sorted by address for membership tests, and indexed by name.
+///
 class AttachedSignalList {
-    // because we dont have heterogeneous lookup yet
-    std::unordered_set<SignalTPtr> m_sptrs;
-    std::unordered_set<SignalT*>   m_ptrs;
+    std::vector<SignalTPtr>                   m_sptrs;
+    std::unordered_map<std::string, SignalT*> m_by_name;
+
+    auto lower_bound(SignalT* ptr) const {
+        return std::lower_bound(
+            m_sptrs.begin(), m_sptrs.end(), ptr, [](auto const& p, SignalT* i) {
+                return std::less<SignalT*>()(p.get(), i);
+            });
+    }
 
 public:
     AttachedSignalList() = default;
 
     template <class Iter>
-    AttachedSignalList(Iter first, Iter last) : m_sptrs(first, last) {
+    AttachedSignalList(Iter first, Iter last) {
         for (auto iter = first; iter != last; iter++) {
-            m_ptrs.insert(iter->get());
+            insert(*iter);
         }
     }
 
     void insert(SignalTPtr const& p) {
         assert(p);
-        m_sptrs.insert(p);
-        m_ptrs.insert(p.get());
+
+        auto iter = lower_bound(p.get());
+
+        if (iter != m_sptrs.end() and iter->get() == p.get()) return;
+
+        m_sptrs.insert(iter, p);
+        m_by_name.try_emplace(p->name(), p.get());
     }
 
-    bool has(SignalT* ptr) const { return m_ptrs.count(ptr); }
+    bool has(SignalT* ptr) const {
+        auto iter = lower_bound(ptr);
+        return iter != m_sptrs.end() and iter->get() == ptr;
+    }
 
     SignalT* find_by_name(std::string const& name) const {
-        for (SignalT* p : m_ptrs) {
-            if (p->name() == name) return p;
-        }
-        return nullptr;
+        auto iter = m_by_name.find(name);
+        if (iter == m_by_name.end()) return nullptr;
+        return iter->second;
     }
 
     template <class T>
     AttachedSignalList& operator=(std::vector<T> const& v) {
         m_sptrs.clear();
-        m_ptrs.clear();
+        m_by_name.clear();
+        m_sptrs.reserve(v.size());
         for (auto const& t : v) {
             insert(t);
         }
@@ -1,5 +1,7 @@
 #include "serialize.h"
 
+#include "noodlesserver.h"
+
 #include "materiallist.h"
 #include "meshlist.h"
 #include "objectlist.h"
@@ -18,27 +20,191 @@
 
 #include <QDebug>
 
+#include <algorithm>
+#include <atomic>
+
 namespace noo {
 
-Writer::Writer() { }
-Writer::~Writer() noexcept {
-    if (!m_written) { qWarning() << "Message should have been written!"; }
+uint8_t* FrameAllocator::allocate(size_t size) {
+    // reuse the smallest storage that fits, and that no frame refers to
+    // anymore, so that large spares are kept for large buffers
+    auto best = m_spare.end();
+
+    for (auto iter = m_spare.begin(); iter != m_spare.end(); ++iter) {
+        if (!iter->isDetached() or size_t(iter->size()) < size) continue;
+
+        if (best == m_spare.end() or iter->size() < best->size()) best = iter;
+    }
+
+    if (best != m_spare.end()) {
+        // frames may be dropped on I/O threads. isDetached() is a relaxed
+        // load of the reference count, so pair it with the release in their
+        // deref: whatever they did with the bytes happens before we write.
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        m_live.push_back(std::move(*best));
+        m_spare.erase(best);
+
+        return reinterpret_cast<uint8_t*>(m_live.back().data());
+    }
+
+    auto& storage = m_live.emplace_back(int(size), Qt::Uninitialized);
+
+    return reinterpret_cast<uint8_t*>(storage.data());
 }
 
-flatbuffers::FlatBufferBuilder& Writer::builder() {
-    return m_builder;
+void FrameAllocator::deallocate(uint8_t* p, size_t) {
+    release(p);
+}
+
+uint8_t* FrameAllocator::reallocate_downward(uint8_t* old_p,
+                                             size_t   old_size,
+                                             size_t   new_size,
+                                             size_t   in_use_back,
+                                             size_t   in_use_front) {
+    m_bytes_copied += in_use_back + in_use_front;
+
+    return Allocator::reallocate_downward(
+        old_p, old_size, new_size, in_use_back, in_use_front);
+}
+
+QByteArray FrameAllocator::release(uint8_t* p) {
+    auto iter = std::find_if(m_live.begin(), m_live.end(), [p](auto const& a) {
+        return a.constData() == reinterpret_cast<char const*>(p);
+    });
+
+    if (iter == m_live.end()) return {};
+
+    QByteArray ret = std::move(*iter);
+
+    m_live.erase(iter);
+
+    // keep a few around; the builder will want storage again soon. storage
+    // that frames still refer to is only reused once they are gone. when
+    // full, the smallest spare goes, as it is the cheapest to allocate again.
+    static constexpr size_t MAX_SPARE = 4;
+
+    if (m_spare.size() >= MAX_SPARE) {
+        m_spare.erase(std::min_element(
+            m_spare.begin(), m_spare.end(), [](auto const& a, auto const& b) {
+                return a.size() < b.size();
+            }));
+    }
+
+    m_spare.push_back(ret);
+
+    return ret;
+}
+
+// =============================
+
+std::unique_ptr<BuilderPool::Entry> BuilderPool::acquire() {
+    if (m_idle.empty()) {
+        m_created++;
+        return std::make_unique<Entry>();
+    }
+
+    auto ret = std::move(m_idle.back());
+    m_idle.pop_back();
+    return ret;
 }
 
-void Writer::finished_writing_and_export() {
+void BuilderPool::release(std::unique_ptr<Entry> entry) {
+    Q_ASSERT(entry);
 
-    auto* ptr  = m_builder.GetBufferPointer();
-    auto  size = m_builder.GetSize();
+    // enough to cover a burst of destinations in one event loop iteration; any
+    // more than that and we just let them go
+    static constexpr size_t MAX_IDLE = 8;
 
-    QByteArray array(reinterpret_cast<char*>(ptr), size);
+    if (m_idle.size() >= MAX_IDLE) return;
 
-    emit data_ready(array);
+    entry->builder.Clear();
 
-    m_written = true;
+    m_idle.push_back(std::move(entry));
+}
+
+// =============================
+
+MessageBatch::MessageBatch(ServerT* s, QObject* parent)
+    : QObject(parent), m_server(s) {
+    m_pool = s ? s->builder_pool() : std::make_shared<BuilderPool>();
+}
+
+MessageBatch::~MessageBatch() noexcept {
+    if (!m_pending.empty()) {
+        qWarning() << "Discarding" << m_pending.size() << "unsent messages";
+    }
+}
+
+flatbuffers::FlatBufferBuilder& MessageBatch::builder() {
+    if (!m_entry) m_entry = m_pool->acquire();
+    return m_entry->builder;
+}
+
+void MessageBatch::append(flatbuffers::Offset<noodles::ServerMessage> m) {
+    m_pending.push_back(m);
+
+    if (m_server) m_server->on_batch_append(*this);
+}
+
+bool MessageBatch::empty() const {
+    return m_pending.empty();
+}
+
+size_t MessageBatch::pending_bytes() const {
+    return m_entry ? m_entry->builder.GetSize() : 0;
+}
+
+MessageFrame MessageBatch::take() {
+    if (m_pending.empty()) return {};
+
+    Q_ASSERT(m_entry);
+
+    auto& builder = m_entry->builder;
+
+    auto sms_handle = noodles::CreateServerMessagesDirect(builder, &m_pending);
+
+    builder.Finish(sms_handle);
+
+    auto const size = builder.GetSize();
+
+    // hand the builder's storage over to the frame, instead of copying it out
+    size_t reserved = 0;
+    size_t offset   = 0;
+
+    uint8_t* raw = builder.ReleaseRaw(reserved, offset);
+
+    QByteArray storage = m_entry->allocator.release(raw);
+
+    Q_ASSERT(!storage.isNull());
+
+    m_pending.clear();
+
+    m_frame_count++;
+    m_byte_count += size;
+    m_bytes_copied += m_entry->allocator.take_bytes_copied();
+
+    m_pool->release(std::move(m_entry));
+
+    return MessageFrame(std::move(storage), int(offset), int(size));
+}
+
+void MessageBatch::flush() {
+    if (m_pending.empty()) return;
+
+    // taken before emitting, receivers may want to write more
+    emit data_ready(take());
+}
+
+// =============================
+
+Writer::Writer(MessageBatch& b) : m_batch(b) { }
+Writer::~Writer() noexcept {
+    if (!m_written) { qWarning() << "Message should have been written!"; }
+}
+
+flatbuffers::FlatBufferBuilder& Writer::builder() {
+    return m_batch.builder();
 }
 
 // =============================
@@ -3,32 +3,162 @@
 
 #include "include/noo_id.h"
 #include "include/noo_server_interface.h"
+#include "messageframe.h"
 #include "src/generated/noodles_server_generated.h"
 
 #include <flatbuffers/flatbuffers.h>
 
 #include <QObject>
 
+#include <memory>
+#include <utility>
+
 namespace noo {
 
-class Writer : public QObject {
+class ServerT;
+
+///
+/// \brief The FrameAllocator class lets a flatbuffer builder work directly in
+/// QByteArray storage, so that finished buffers can be handed out as frames
+/// without a copy.
+///
+/// Storage that has been released to frames is kept, and reused once every
+/// frame referring to it is gone. Builders release their buffer with each
+/// frame, so this spare storage, and not the builder, is what carries grown
+/// capacity from one batch to the next.
+///
+class FrameAllocator : public flatbuffers::Allocator {
+    std::vector<QByteArray> m_live;
+    std::vector<QByteArray> m_spare;
+
+    size_t m_bytes_copied = 0;
+
+public:
+    uint8_t* allocate(size_t size) override;
+    void     deallocate(uint8_t* p, size_t size) override;
+    uint8_t* reallocate_downward(uint8_t* old_p,
+                                 size_t   old_size,
+                                 size_t   new_size,
+                                 size_t   in_use_back,
+                                 size_t   in_use_front) override;
+
+    /// Take the storage backing a buffer released from the builder.
+    QByteArray release(uint8_t* p);
+
+    /// Bytes moved around while growing buffers since the last call
+    size_t take_bytes_copied() { return std::exchange(m_bytes_copied, 0); }
+};
+
+///
+/// \brief The BuilderPool class keeps idle flatbuffer builders, along with
+/// their storage, so that batches only hold a builder while they have messages
+/// pending.
+///
+/// Pools are shared between the batches that use them, so that a batch can
+/// outlive the server that created it.
+///
+class BuilderPool {
+public:
+    struct Entry {
+        FrameAllocator                 allocator;
+        flatbuffers::FlatBufferBuilder builder { 1024, &allocator };
+    };
+
+private:
+    std::vector<std::unique_ptr<Entry>> m_idle;
+
+    size_t m_created = 0;
+
+public:
+    /// Get an empty builder, creating one if none are idle
+    std::unique_ptr<Entry> acquire();
+
+    /// Return a cleared builder to the pool
+    void release(std::unique_ptr<Entry>);
+
+    size_t idle_count() const { return m_idle.size(); }
+    size_t created_count() const { return m_created; }
+};
+
+///
+/// \brief The MessageBatch class accumulates messages bound for a single
+/// destination (all clients, one client, or the subscribers of a table) into
+/// one ServerMessages buffer.
+///
+/// The owning server flushes a batch once per event loop iteration, or early if
+/// the batch grows too large or a message for another destination arrives. A
+/// batch without a server is never flushed automatically; use take() instead.
+///
+/// A builder is borrowed from the server's pool when the first message is
+/// written, and given back when the batch is taken.
+///
+class MessageBatch : public QObject {
     Q_OBJECT
 
-    flatbuffers::FlatBufferBuilder m_builder;
+    ServerT* m_server;
 
-    bool m_written = false;
+    std::shared_ptr<BuilderPool>        m_pool;
+    std::unique_ptr<BuilderPool::Entry> m_entry;
+
+    std::vector<flatbuffers::Offset<noodles::ServerMessage>> m_pending;
 
-    void finished_writing_and_export();
+    size_t m_frame_count  = 0;
+    size_t m_byte_count   = 0;
+    size_t m_bytes_copied = 0;
 
 public:
-    Writer();
-    ~Writer() noexcept override;
+    MessageBatch(ServerT*, QObject* parent);
+    ~MessageBatch() noexcept override;
+
+    flatbuffers::FlatBufferBuilder& builder();
+
+    void append(flatbuffers::Offset<noodles::ServerMessage>);
+
+    ServerT* server() const { return m_server; }
+
+    bool   empty() const;
+    size_t pending_bytes() const;
+
+    /// Finish the pending messages into a frame and return it, without
+    /// emitting data_ready.
+    MessageFrame take();
+
+    void flush();
+
+    size_t frame_count() const { return m_frame_count; }
+    size_t byte_count() const { return m_byte_count; }
+    size_t bytes_copied() const { return m_bytes_copied; }
+
+signals:
+    void data_ready(MessageFrame);
+};
+
+///
+/// \brief The Writer class is used to add messages to a batch.
+///
+/// Merged component updates wait for the next flush, so a message written
+/// meanwhile may reach clients before them. Messages that depend on those
+/// updates, deletes and method replies, write them first; see
+/// ServerT::write_dirty_lists(). Creates, signals, and table messages do
+/// not, so that they do not break up the merging.
+///
+class Writer {
+    MessageBatch& m_batch;
+
+    bool m_written = false;
+
+public:
+    explicit Writer(MessageBatch&);
+    ~Writer() noexcept;
+
+    Writer(Writer const&) = delete;
+    Writer& operator=(Writer const&) = delete;
 
     flatbuffers::FlatBufferBuilder& builder();
 
     operator flatbuffers::FlatBufferBuilder&() { return builder(); }
 
-    flatbuffers::FlatBufferBuilder* operator->() { return &m_builder; }
+    flatbuffers::FlatBufferBuilder* operator->() { return &builder(); }
 
     template <class T>
     void complete_message(flatbuffers::Offset<T> message) {
@@ -37,20 +167,12 @@ public:
         Q_ASSERT(enum_value != noodles::ServerMessageType::NONE);
 
         auto sm = noodles::CreateServerMessage(
-            m_builder, enum_value, message.Union());
+            builder(), enum_value, message.Union());
 
-        std::vector<flatbuffers::Offset<noodles::ServerMessage>> sms;
+        m_batch.append(sm);
 
-        sms.push_back(sm);
-
-        auto sms_handle = noodles::CreateServerMessagesDirect(m_builder, &sms);
-
-        m_builder.Finish(sms_handle);
-        finished_writing_and_export();
+        m_written = true;
     }
-
-signals:
-    void data_ready(QByteArray);
 };
 
 } // namespace noo
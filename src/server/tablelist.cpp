@@ -3,8 +3,12 @@
 #include "noodlesserver.h"
 #include "noodlesstate.h"
 #include "serialize.h"
+#include "src/common/logging.h"
 #include "src/generated/interface_tools.h"
 
+#include <algorithm>
+#include <numeric>
+
 namespace noo {
 
 TableList::TableList(ServerT* s) : ComponentListBase(s) { }
@@ -16,30 +20,48 @@ TableList::~TableList() { }
 TableT::TableT(IDType id, TableList* host, TableData const& d)
     : ComponentMixin(id, host), m_data(d) {
 
+    m_subscriber_batch = new MessageBatch(host->server(), this);
+    m_columnar_batch   = new MessageBatch(host->server(), this);
+
+    connect(m_subscriber_batch,
+            &MessageBatch::data_ready,
+            this,
+            &TableT::send_data);
+
+    connect(m_columnar_batch,
+            &MessageBatch::data_ready,
+            this,
+            &TableT::send_data_columnar);
+
     // load signals
 
     auto doc = host->server()->state()->document();
 
     for (auto e : { BuiltinMethods::TABLE_SUBSCRIBE,
+                    BuiltinMethods::TABLE_SUBSCRIBE_WINDOW,
                     BuiltinMethods::TABLE_INSERT,
                     BuiltinMethods::TABLE_UPDATE,
                     BuiltinMethods::TABLE_REMOVE,
                     BuiltinMethods::TABLE_CLEAR,
-                    BuiltinMethods::TABLE_UPDATE_SELECTION }) {
+                    BuiltinMethods::TABLE_UPDATE_SELECTION,
+                    BuiltinMethods::TABLE_SELECT,
+                    BuiltinMethods::TABLE_TOP_K,
+                    BuiltinMethods::TABLE_GROUP_BY }) {
         m_method_list.insert(doc->get_builtin(e));
     }
 
     for (auto e : { BuiltinSignals::TABLE_SIG_RESET,
                     BuiltinSignals::TABLE_SIG_ROWS_DELETED,
                     BuiltinSignals::TABLE_SIG_DATA_UPDATED,
+                    BuiltinSignals::TABLE_SIG_DATA_UPDATED_COLUMNAR,
                     BuiltinSignals::TABLE_SIG_SELECTION_CHANGED }) {
         m_signal_list.insert(doc->get_builtin(e));
     }
 
     connect(m_data.source.get(),
-            &TableSource::table_selection_updated,
+            &TableSource::table_selection_changed,
             this,
-            &TableT::on_table_selection_updated);
+            &TableT::on_table_selection_changed);
 
     connect(m_data.source.get(),
             &TableSource::table_row_deleted,
@@ -57,6 +79,12 @@ TableT::TableT(IDType id, TableList* host, TableData const& d)
             &TableT::on_table_reset);
 }
 
+TableT::~TableT() {
+    // subscribers should get anything still pending before the table goes
+    m_subscriber_batch->flush();
+    m_columnar_batch->flush();
+}
+
 AttachedMethodList& TableT::att_method_list() {
     return m_method_list;
 }
@@ -96,29 +124,279 @@ TableSource* TableT::get_source() const {
     return m_data.source.get();
 }
 
+MessageBatch& TableT::subscriber_batch() {
+    return *m_subscriber_batch;
+}
+
+MessageBatch& TableT::columnar_batch() {
+    return *m_columnar_batch;
+}
+
+void TableT::fire_to_whole_table(SignalT& sig, AnyVarList&& args) {
+    if (m_columnar_subscribers > 0) {
+        sig.fire(id(), AnyVarList(args), columnar_batch());
+    }
+
+    if (m_plain_subscribers > 0) {
+        sig.fire(id(), std::move(args), subscriber_batch());
+    }
+}
+
+namespace {
+
+/// Some of the rows and columns of another query
+struct SubsetQuery : TableQuery {
+    TableQueryPtr        source;
+    std::vector<size_t>  rows;
+    std::vector<int64_t> keys;
+    std::vector<size_t>  cols;
+
+    bool is_column_string(size_t col) const override {
+        return source->is_column_string(cols.at(col));
+    }
+
+    bool get_reals_to(size_t col, std::span<double> dest) const override {
+        std::vector<double> all(source->num_rows);
+
+        if (!source->get_reals_to(cols.at(col), all)) return false;
+
+        auto const count = std::min(rows.size(), dest.size());
+
+        for (size_t i = 0; i < count; i++) {
+            dest[i] = all[rows[i]];
+        }
+
+        return true;
+    }
+
+    bool
+    get_cell_to(size_t col, size_t row, std::string_view& s) const override {
+        if (row >= rows.size() or col >= cols.size()) return false;
+        return source->get_cell_to(cols[col], rows[row], s);
+    }
+
+    bool get_codes_to(size_t                        col,
+                      std::span<int32_t>            dest,
+                      std::span<std::string const>& dictionary) const override {
+        std::vector<int32_t> all(source->num_rows);
+
+        if (!source->get_codes_to(cols.at(col), all, dictionary)) return false;
+
+        auto const count = std::min(rows.size(), dest.size());
+
+        for (size_t i = 0; i < count; i++) {
+            dest[i] = all[rows[i]];
+        }
+
+        return true;
+    }
+
+    bool get_keys_to(std::span<int64_t> dest) const override {
+        copy_range(keys, dest);
+        return true;
+    }
+};
+
+/// Flag the rows of a query a subscription should see
+std::vector<bool> rows_for(TableSubscription const& sub,
+                           TableQuery const&        q,
+                           std::span<int64_t const> keys) {
+    auto ret = std::vector<bool>(q.num_rows, true);
+
+    if (sub.filter.has_predicates()) ret = sub.filter.match(q);
+
+    if (sub.window) {
+        for (size_t i = 0; i < ret.size() and i < keys.size(); i++) {
+            if (!sub.window->contains(keys[i])) ret[i] = false;
+        }
+    }
+
+    return ret;
+}
+
+/// Take the flagged rows and given columns of a query. Returns the query
+/// itself if that is everything.
+TableQueryPtr make_subset(TableQueryPtr const&       q,
+                          std::span<int64_t const>   keys,
+                          std::vector<bool> const&   pass,
+                          std::vector<size_t> const& columns) {
+    auto ret = std::make_shared<SubsetQuery>();
+
+    for (size_t i = 0; i < keys.size() and i < pass.size(); i++) {
+        if (!pass[i]) continue;
+
+        ret->rows.push_back(i);
+        ret->keys.push_back(keys[i]);
+    }
+
+    if (ret->rows.size() == q->num_rows and columns.empty()) return q;
+
+    ret->source = q;
+
+    if (columns.empty()) {
+        ret->cols.resize(q->num_cols);
+        std::iota(ret->cols.begin(), ret->cols.end(), size_t(0));
+    } else {
+        ret->cols = columns;
+    }
+
+    ret->num_cols = ret->cols.size();
+    ret->num_rows = ret->rows.size();
+
+    return ret;
+}
+
+} // namespace
+
+std::vector<bool> TableFilter::match(TableQuery const& q) const {
+    std::vector<bool> ret(q.num_rows, true);
+
+    std::vector<double> reals(q.num_rows);
+
+    for (auto const& r : ranges) {
+        if (!q.get_reals_to(r.column, reals)) {
+            ret.assign(ret.size(), false);
+            break;
+        }
+
+        for (size_t i = 0; i < ret.size(); i++) {
+            if (!(reals[i] >= r.min and reals[i] <= r.max)) ret[i] = false;
+        }
+    }
+
+    for (auto const& e : equals) {
+        for (size_t i = 0; i < ret.size(); i++) {
+            if (!ret[i]) continue;
+
+            std::string_view value;
+
+            if (!q.get_cell_to(e.column, i, value) or value != e.value) {
+                ret[i] = false;
+            }
+        }
+    }
+
+    return ret;
+}
+
+TableQueryPtr TableT::add_subscriber(ClientT*          client,
+                                     TableQueryPtr     initial,
+                                     TableSubscription subscription) {
+    if (!client) return initial;
+
+    auto [iter, is_new] = m_subscribers.try_emplace(client);
+
+    if (is_new) {
+        connect(client,
+                &QObject::destroyed,
+                this,
+                &TableT::on_subscriber_destroyed);
+    }
+
+    auto& s = iter->second;
+
+    s.client       = client;
+    s.subscription = std::move(subscription);
+    s.visible.clear();
+
+    count_subscribers();
+
+    // a client is only connected to the batch of the encoding it asked for
+    disconnect(this, &TableT::send_data, client, &ClientT::send);
+    disconnect(this, &TableT::send_data_columnar, client, &ClientT::send);
+
+    if (s.subscription.is_whole_table()) {
+        connect(this,
+                s.subscription.columnar ? &TableT::send_data_columnar
+                                        : &TableT::send_data,
+                client,
+                &ClientT::send);
+
+        return initial;
+    }
+
+    std::vector<int64_t> keys(initial->num_rows);
+    initial->get_keys_to(keys);
+
+    auto const pass = rows_for(s.subscription, *initial, keys);
+
+    if (s.subscription.filter.has_predicates()) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (pass[i]) s.visible.insert(keys[i]);
+        }
+    }
+
+    return make_subset(initial, keys, pass, s.subscription.filter.columns);
+}
+
+void TableT::count_subscribers() {
+    m_plain_subscribers    = 0;
+    m_columnar_subscribers = 0;
+
+    for (auto const& [key, s] : m_subscribers) {
+        if (!s.subscription.is_whole_table()) continue;
+
+        if (s.subscription.columnar) {
+            m_columnar_subscribers++;
+        } else {
+            m_plain_subscribers++;
+        }
+    }
+}
+
+void TableT::on_subscriber_destroyed(QObject* client) {
+    m_subscribers.erase(client);
+    count_subscribers();
+}
+
 static SignalTPtr get_builtin_signal(TableT& n, BuiltinSignals s) {
     return n.hosting_list()->server()->state()->document()->get_builtin(s);
 }
 
 template <class... Args>
-static void send_table_signal(TableT& n, BuiltinSignals bs, Args&&... args) {
+static void send_table_signal(TableT&        n,
+                              MessageBatch&  batch,
+                              BuiltinSignals bs,
+                              Args&&... args) {
     auto sig = get_builtin_signal(n, bs);
 
     if (!sig) return;
 
     auto to_send = marshall_to_any(std::forward<Args>(args)...);
 
-    sig->fire(n.id(), std::move(to_send));
+    sig->fire(n.id(), std::move(to_send), batch);
 }
 
+void TableT::send_to_subscribers(SignalTPtr const& sig, AnyVarList&& args) {
+    if (!sig) return;
 
-void TableT::on_table_selection_updated(std::string         name,
-                                        SelectionRef const& ref) {
-    qDebug() << "Table emit" << Q_FUNC_INFO
-             << QString::fromStdString(ref.to_any().dump_string());
+    for (auto const& [key, s] : m_subscribers) {
+        if (s.subscription.is_whole_table()) continue;
+        sig->fire(id(), AnyVarList(args), s.client->batch());
+    }
 
-    send_table_signal(
-        *this, BuiltinSignals::TABLE_SIG_SELECTION_CHANGED, name, ref.to_any());
+    fire_to_whole_table(*sig, std::move(args));
+}
+
+void TableT::on_table_selection_changed(std::string   name,
+                                        RowSet const& added,
+                                        RowSet const& removed) {
+    qCDebug(log_table) << "Table emit" << Q_FUNC_INFO << added.size()
+                       << removed.size();
+
+    // only the change is sent; clients keep the rest
+    AnyVar change;
+
+    {
+        auto& map = change.emplace<AnyVarMap>();
+
+        map["added"].emplace<std::vector<std::byte>>(added.encode());
+        map["removed"].emplace<std::vector<std::byte>>(removed.encode());
+    }
+
+    send_to_subscribers(
+        get_builtin_signal(*this, BuiltinSignals::TABLE_SIG_SELECTION_CHANGED),
+        marshall_to_any(name, std::move(change)));
 }
 
 void TableT::on_table_row_deleted(TableQueryPtr q) {
@@ -128,51 +406,143 @@ void TableT::on_table_row_deleted(TableQueryPtr q) {
 
     q->get_keys_to(keys);
 
+    for (auto& [key, s] : m_subscribers) {
+        auto const& sub = s.subscription;
+
+        if (sub.is_whole_table()) continue;
+
+        std::vector<int64_t> seen;
+
+        for (auto k : keys) {
+            if (sub.window and !sub.window->contains(k)) continue;
+            if (sub.filter.has_predicates() and !s.visible.erase(k)) continue;
+            seen.push_back(k);
+        }
+
+        if (seen.empty()) continue;
+
+        AnyVar v = std::move(seen);
+
+        send_table_signal(*this,
+                          s.client->batch(),
+                          BuiltinSignals::TABLE_SIG_ROWS_DELETED,
+                          v);
+    }
+
     AnyVar v = std::move(keys);
 
-    qDebug() << "Table emit" << Q_FUNC_INFO
-             << QString::fromStdString(v.dump_string());
+    qCDebug(log_table) << "Table emit" << Q_FUNC_INFO
+                       << QString::fromStdString(v.dump_string());
+
+    auto sig =
+        get_builtin_signal(*this, BuiltinSignals::TABLE_SIG_ROWS_DELETED);
 
-    send_table_signal(*this, BuiltinSignals::TABLE_SIG_ROWS_DELETED, v);
+    if (sig) fire_to_whole_table(*sig, marshall_to_any(v));
 }
 
 void TableT::on_table_row_updated(TableQueryPtr q) {
+    if (m_columnar_subscribers > 0) send_update(*q, true, columnar_batch());
+    if (m_plain_subscribers > 0) send_update(*q, false, subscriber_batch());
+
+    auto const whole_table = m_plain_subscribers + m_columnar_subscribers;
+
+    if (m_subscribers.size() == whole_table) return;
+
+    std::vector<int64_t> keys(q->num_rows);
+
+    q->get_keys_to(keys);
+
+    for (auto& [key, s] : m_subscribers) {
+        if (s.subscription.is_whole_table()) continue;
+        send_filtered_update(s, q, keys);
+    }
+}
+
+void TableT::send_filtered_update(Subscriber&              s,
+                                  TableQueryPtr const&     q,
+                                  std::span<int64_t const> keys) {
+    auto const& sub = s.subscription;
+
+    auto const pass = rows_for(sub, *q, keys);
+
+    auto part = make_subset(q, keys, pass, sub.filter.columns);
+
+    if (part->num_rows > 0) send_update(*part, sub.columnar, s.client->batch());
+
+    if (!sub.filter.has_predicates()) return;
+
+    // rows that no longer pass have to be taken away from the subscriber
+
+    std::vector<int64_t> gone;
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (pass[i]) {
+            s.visible.insert(keys[i]);
+        } else if (s.visible.erase(keys[i])) {
+            gone.push_back(keys[i]);
+        }
+    }
+
+    if (gone.empty()) return;
+
+    AnyVar v = std::move(gone);
+
+    send_table_signal(
+        *this, s.client->batch(), BuiltinSignals::TABLE_SIG_ROWS_DELETED, v);
+}
+
+void TableT::send_update(TableQuery const& q,
+                         bool              columnar,
+                         MessageBatch&     batch) {
+    if (!columnar) {
+        send_plain_update(q, batch);
+        return;
+    }
+
+    AnyVar bytes;
+    bytes.emplace<std::vector<std::byte>>(encode_columnar(q));
+
+    send_table_signal(
+        *this, batch, BuiltinSignals::TABLE_SIG_DATA_UPDATED_COLUMNAR, bytes);
+}
+
+void TableT::send_plain_update(TableQuery const& q, MessageBatch& batch) {
     AnyVar kv;
     AnyVar cols;
 
     {
         std::vector<int64_t> keys;
-        keys.resize(q->num_rows);
+        keys.resize(q.num_rows);
 
-        q->get_keys_to(keys);
+        q.get_keys_to(keys);
 
         kv = std::move(keys);
     }
 
     {
         AnyVarList l;
-        l.reserve(q->num_cols);
+        l.reserve(q.num_cols);
 
-        for (size_t i = 0; i < q->num_cols; i++) {
+        for (size_t i = 0; i < q.num_cols; i++) {
             AnyVar this_c;
 
-            if (q->is_column_string(i)) {
-                AnyVarList avl(q->num_rows);
+            if (q.is_column_string(i)) {
+                AnyVarList avl(q.num_rows);
 
                 for (size_t row_i = 0; row_i < avl.size(); row_i++) {
                     std::string_view value_view;
 
-                    q->get_cell_to(i, row_i, value_view);
+                    q.get_cell_to(i, row_i, value_view);
 
-                    avl[i] = std::string(value_view);
+                    avl[row_i] = std::string(value_view);
                 }
 
                 this_c = std::move(avl);
 
             } else {
-                std::vector<double> d(q->num_rows);
+                std::vector<double> d(q.num_rows);
 
-                q->get_reals_to(i, d);
+                q.get_reals_to(i, d);
 
                 this_c = std::move(d);
             }
@@ -183,16 +553,58 @@ void TableT::on_table_row_updated(TableQueryPtr q) {
         cols = std::move(l);
     }
 
-    qDebug() << "Table emit" << Q_FUNC_INFO
-             << QString::fromStdString(kv.dump_string())
-             << QString::fromStdString(cols.dump_string());
+    qCDebug(log_table) << "Table emit" << Q_FUNC_INFO
+                       << QString::fromStdString(kv.dump_string())
+                       << QString::fromStdString(cols.dump_string());
 
-    send_table_signal(*this, BuiltinSignals::TABLE_SIG_DATA_UPDATED, kv, cols);
+    send_table_signal(
+        *this, batch, BuiltinSignals::TABLE_SIG_DATA_UPDATED, kv, cols);
 }
 
 void TableT::on_table_reset() {
-    qDebug() << "Table emit" << Q_FUNC_INFO;
-    send_table_signal(*this, BuiltinSignals::TABLE_SIG_RESET);
+    qCDebug(log_table) << "Table emit" << Q_FUNC_INFO;
+    send_to_subscribers(
+        get_builtin_signal(*this, BuiltinSignals::TABLE_SIG_RESET), {});
+}
+
+// =============================================================================
+
+std::vector<std::byte> encode_columnar(TableQuery const& q) {
+    ColumnarTableWriter writer(q.num_rows, q.num_cols);
+
+    q.get_keys_to(writer.keys());
+
+    std::vector<std::string_view> cells;
+    std::vector<int32_t>          codes;
+
+    for (size_t ci = 0; ci < q.num_cols; ci++) {
+        if (!q.is_column_string(ci)) {
+            q.get_reals_to(ci, writer.add_reals());
+            continue;
+        }
+
+        std::span<std::string const> dictionary;
+
+        codes.assign(q.num_rows, 0);
+
+        if (q.get_codes_to(ci, codes, dictionary)) {
+            // each distinct string is sent once, rather than once per row
+            auto dest = writer.add_dictionary(dictionary);
+            copy_range(codes, dest);
+            continue;
+        }
+
+        // views into the source; the strings are copied once, into the blob
+        cells.assign(q.num_rows, {});
+
+        for (size_t ri = 0; ri < q.num_rows; ri++) {
+            q.get_cell_to(ci, ri, cells[ri]);
+        }
+
+        writer.add_strings(cells);
+    }
+
+    return writer.take();
 }
 
 } // namespace noo
@@ -8,10 +8,68 @@
 
 #include <QByteArray>
 
+#include <limits>
+#include <optional>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace noo {
 
+class ClientT;
+
+///
+/// \brief The TableWindow struct is the inclusive range of keys that a
+/// windowed subscriber sees.
+///
+struct TableWindow {
+    int64_t first_key = std::numeric_limits<int64_t>::min();
+    int64_t last_key  = std::numeric_limits<int64_t>::max();
+
+    bool contains(int64_t key) const {
+        return key >= first_key and key <= last_key;
+    }
+};
+
+///
+/// \brief The TableFilter struct narrows what a subscriber is sent, to some
+/// of the columns, and to the rows that pass every predicate.
+///
+struct TableFilter {
+    /// Source columns to send, in order. Empty for all.
+    std::vector<size_t> columns;
+
+    /// A real column must be within [min, max]
+    struct Range {
+        size_t column;
+        double min;
+        double max;
+    };
+
+    /// A string column must be equal to a value
+    struct Equals {
+        size_t      column;
+        std::string value;
+    };
+
+    std::vector<Range>  ranges;
+    std::vector<Equals> equals;
+
+    bool has_predicates() const { return !ranges.empty() or !equals.empty(); }
+
+    /// Flag the rows of a query that pass the predicates
+    std::vector<bool> match(TableQuery const&) const;
+};
+
+struct TableSubscription {
+    bool                       columnar = false;
+    std::optional<TableWindow> window;
+    TableFilter                filter;
+
+    bool is_whole_table() const {
+        return !window and filter.columns.empty() and !filter.has_predicates();
+    }
+};
+
 class TableList : public ComponentListBase<TableList, TableID, TableT> {
 public:
     TableList(ServerT*);
@@ -27,8 +85,39 @@ class TableT : public ComponentMixin<TableT, TableList, TableID> {
     AttachedMethodList m_method_list;
     AttachedSignalList m_signal_list;
 
+    // whole table subscribers, one batch for each encoding, so that no one is
+    // sent an update twice
+    MessageBatch* m_subscriber_batch;
+    MessageBatch* m_columnar_batch;
+
+    struct Subscriber {
+        ClientT*          client = nullptr;
+        TableSubscription subscription;
+
+        // filtered subscribers are sent signals through their own batch, and
+        // only for what passes the filter. if rows are filtered by value, we
+        // track the keys they have, so rows that stop passing can be removed.
+        std::unordered_set<int64_t> visible;
+    };
+
+    std::unordered_map<QObject*, Subscriber> m_subscribers;
+
+    // whole table subscribers, by encoding
+    size_t m_plain_subscribers    = 0;
+    size_t m_columnar_subscribers = 0;
+
+    void count_subscribers();
+
+    void send_to_subscribers(SignalTPtr const&, AnyVarList&&);
+    void send_filtered_update(Subscriber&,
+                              TableQueryPtr const&,
+                              std::span<int64_t const> keys);
+    void send_update(TableQuery const&, bool columnar, MessageBatch&);
+    void send_plain_update(TableQuery const&, MessageBatch&);
+
 public:
     TableT(IDType, TableList*, TableData const&);
+    ~TableT();
 
     AttachedMethodList& att_method_list();
     AttachedSignalList& att_signal_list();
@@ -38,16 +127,41 @@ public:
 
     TableSource* get_source() const;
 
+    /// Batch for whole table subscribers that take plain updates
+    MessageBatch& subscriber_batch();
+
+    /// Batch for whole table subscribers that take columnar updates
+    MessageBatch& columnar_batch();
+
+    /// Fire a signal to every whole table subscriber, through the batch of
+    /// each encoding in use
+    void fire_to_whole_table(SignalT&, AnyVarList&&);
+
+    /// Subscribe a client, or change its subscription, and return the part
+    /// of the initial query to send it. Whole table subscribers share the
+    /// batch of the encoding they asked for; filtered ones are only sent what
+    /// passes their filter. Updates are only built in the encodings that
+    /// current subscribers asked for.
+    TableQueryPtr
+    add_subscriber(ClientT*, TableQueryPtr initial, TableSubscription);
+
 signals:
-    void send_data(QByteArray);
+    void send_data(MessageFrame);
+    void send_data_columnar(MessageFrame);
 
 private slots:
     void on_table_reset();
-    void on_table_selection_updated(std::string, SelectionRef const&);
+    void on_table_selection_changed(std::string,
+                                    RowSet const& added,
+                                    RowSet const& removed);
     void on_table_row_updated(TableQueryPtr);
     void on_table_row_deleted(TableQueryPtr);
+    void on_subscriber_destroyed(QObject*);
 };
 
+/// Encode a query as a ColumnarTable
+std::vector<std::byte> encode_columnar(TableQuery const&);
+
 } // namespace noo
 
 #endif // TABLELIST_H
@@ -0,0 +1,272 @@
+#include "tablescan.h"
+
+#include "src/common/column_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+
+namespace noo {
+
+namespace {
+
+/// mask[i] &= (v[i] == value)
+void and_equal(StringColumnView   v,
+               std::string_view   value,
+               std::span<uint8_t> mask) {
+    auto const n = std::min(v.size(), mask.size());
+
+    if (auto const* d = v.dictionary()) {
+        // one string compare, and then only codes
+        auto const code  = d->find(value);
+        auto const codes = d->codes();
+
+        for (size_t i = 0; i < n; i++) {
+            mask[i] &= uint8_t(codes[i] == code);
+        }
+
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            if (mask[i]) mask[i] = uint8_t(v[i] == value);
+        }
+    }
+
+    std::fill(mask.begin() + n, mask.end(), uint8_t(0));
+}
+
+template <class Values>
+void top_k_by(Values const&        values,
+              std::vector<size_t>& rows,
+              size_t               k,
+              bool                 descending) {
+    using T = std::remove_cvref_t<decltype(values[0])>;
+
+    // rows without a value, or with one that does not order, are dropped
+    std::erase_if(rows, [&values](size_t r) {
+        if (r >= values.size()) return true;
+        if constexpr (std::is_floating_point_v<T>) {
+            if (std::isnan(values[r])) return true;
+        }
+        return false;
+    });
+
+    k = std::min(k, rows.size());
+
+    auto order = [&values, descending](size_t a, size_t b) {
+        return descending ? values[b] < values[a] : values[a] < values[b];
+    };
+
+    std::partial_sort(rows.begin(), rows.begin() + k, rows.end(), order);
+
+    rows.resize(k);
+}
+
+constexpr size_t no_group = std::numeric_limits<size_t>::max();
+
+/// Find the group of each row, creating groups as new values are seen. All
+/// NaN values share one group.
+template <class Key, class Values>
+std::vector<size_t> assign_groups(Values const&           values,
+                                  std::span<size_t const> rows,
+                                  GroupSummary&           summary) {
+    std::vector<size_t> ret(rows.size(), no_group);
+
+    std::unordered_map<Key, size_t> index;
+
+    // NaN never compares equal, so it cannot be a key
+    size_t nan_group = no_group;
+
+    auto new_group = [&summary](size_t r) {
+        summary.group_rows.push_back(r);
+        summary.counts.push_back(0);
+        return summary.group_rows.size() - 1;
+    };
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        auto const r = rows[i];
+
+        if (r >= values.size()) continue;
+
+        size_t g;
+
+        if constexpr (std::is_floating_point_v<Key>) {
+            if (std::isnan(values[r])) {
+                if (nan_group == no_group) nan_group = new_group(r);
+
+                ret[i] = nan_group;
+                summary.counts[nan_group]++;
+                continue;
+            }
+        }
+
+        auto iter = index.find(Key(values[r]));
+
+        if (iter == index.end()) {
+            g = new_group(r);
+            index.emplace(Key(values[r]), g);
+        } else {
+            g = iter->second;
+        }
+
+        ret[i] = g;
+        summary.counts[g]++;
+    }
+
+    return ret;
+}
+
+/// Rows, sorted by group, and where the run of each group starts. Rows past
+/// the end of the values, or with a NaN value, are left out.
+struct GroupRuns {
+    std::vector<size_t> rows;
+    std::vector<size_t> starts;
+};
+
+GroupRuns make_runs(std::span<size_t const> rows,
+                    std::span<size_t const> group_of,
+                    size_t                  num_groups,
+                    std::span<double const> values) {
+    GroupRuns ret;
+
+    ret.starts.assign(num_groups + 1, 0);
+
+    auto skip = [&](size_t i) {
+        return group_of[i] == no_group or rows[i] >= values.size() or
+               std::isnan(values[rows[i]]);
+    };
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (skip(i)) continue;
+        ret.starts[group_of[i] + 1]++;
+    }
+
+    std::partial_sum(ret.starts.begin(), ret.starts.end(), ret.starts.begin());
+
+    ret.rows.resize(ret.starts.back());
+
+    auto next = ret.starts;
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (skip(i)) continue;
+        ret.rows[next[group_of[i]]++] = rows[i];
+    }
+
+    return ret;
+}
+
+} // namespace
+
+std::vector<uint8_t> scan_rows(TableSource const& source,
+                               TableFilter const& filter) {
+    auto const& columns = source.get_columns();
+
+    std::vector<uint8_t> mask(source.get_row_to_key_map().size(), 1);
+
+    for (auto const& r : filter.ranges) {
+        column_and_range(
+            columns.at(r.column).as_doubles(), r.min, r.max, mask);
+    }
+
+    for (auto const& e : filter.equals) {
+        and_equal(columns.at(e.column).as_string(), e.value, mask);
+    }
+
+    return mask;
+}
+
+std::vector<size_t> flagged_rows(std::span<uint8_t const> mask) {
+    std::vector<size_t> ret;
+
+    for (size_t i = 0; i < mask.size(); i++) {
+        if (mask[i]) ret.push_back(i);
+    }
+
+    return ret;
+}
+
+void keep_top_k(TableSource const&   source,
+                std::vector<size_t>& rows,
+                size_t               column,
+                size_t               k,
+                bool                 descending) {
+    auto const& c = source.get_columns().at(column);
+
+    if (c.is_string()) {
+        top_k_by(c.as_string(), rows, k, descending);
+    } else {
+        top_k_by(c.as_doubles(), rows, k, descending);
+    }
+}
+
+GroupSummary group_rows(TableSource const&      source,
+                        std::span<size_t const> rows,
+                        size_t                  group_column,
+                        std::span<size_t const> value_columns) {
+    auto const& columns = source.get_columns();
+    auto const& group   = columns.at(group_column);
+
+    GroupSummary ret;
+
+    auto const strings = group.as_string();
+
+    std::vector<size_t> group_of;
+
+    if (auto const* d = strings.dictionary()) {
+        // equal strings have equal codes, so group on those
+        group_of = assign_groups<int32_t>(d->codes(), rows, ret);
+    } else if (group.is_string()) {
+        group_of = assign_groups<std::string_view>(strings, rows, ret);
+    } else {
+        group_of = assign_groups<double>(group.as_doubles(), rows, ret);
+    }
+
+    auto const num_groups = ret.group_rows.size();
+    auto const nan        = std::numeric_limits<double>::quiet_NaN();
+
+    // the values of each group are gathered into one run, so that they can be
+    // reduced with the column kernels. NaNs are left out of the runs, so sum
+    // and mean skip them as min and max do.
+
+    std::vector<double> gathered;
+
+    for (auto vc : value_columns) {
+        auto const values = columns.at(vc).as_doubles();
+
+        auto const runs = make_runs(rows, group_of, num_groups, values);
+
+        gathered.resize(runs.rows.size());
+        column_gather(values, runs.rows, gathered);
+
+        auto& s = ret.stats.emplace_back();
+
+        s.sum.resize(num_groups);
+        s.min.resize(num_groups);
+        s.max.resize(num_groups);
+        s.mean.resize(num_groups);
+
+        for (size_t g = 0; g < num_groups; g++) {
+            auto const run = std::span<double const>(gathered).subspan(
+                runs.starts[g], runs.starts[g + 1] - runs.starts[g]);
+
+            s.sum[g] = column_sum(run);
+
+            if (run.empty()) {
+                s.min[g]  = nan;
+                s.max[g]  = nan;
+                s.mean[g] = nan;
+                continue;
+            }
+
+            s.min[g]  = column_min(run);
+            s.max[g]  = column_max(run);
+            s.mean[g] = s.sum[g] / double(run.size());
+        }
+    }
+
+    return ret;
+}
+
+} // namespace noo
@@ -0,0 +1,60 @@
+#ifndef TABLESCAN_H
+#define TABLESCAN_H
+
+#include "tablelist.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace noo {
+
+// These work directly on the columns of a source, a whole column at a time,
+// so that clients can ask for selections and summaries instead of pulling
+// rows. Sources should be compacted first.
+
+/// Flag, with 1 or 0, the rows of a source that pass the predicates of a
+/// filter
+std::vector<uint8_t> scan_rows(TableSource const&, TableFilter const&);
+
+/// Row indices of the flagged rows
+std::vector<size_t> flagged_rows(std::span<uint8_t const>);
+
+/// Sort rows by the values of a column, and keep the first k
+void keep_top_k(TableSource const&   source,
+                std::vector<size_t>& rows,
+                size_t               column,
+                size_t               k,
+                bool                 descending);
+
+///
+/// \brief The GroupSummary struct holds per group aggregates of a set of rows.
+///
+struct GroupSummary {
+    /// A row holding the group value of each group, in order of first
+    /// appearance
+    std::vector<size_t>  group_rows;
+    std::vector<int64_t> counts;
+
+    struct Stats {
+        std::vector<double> sum;
+        std::vector<double> min;
+        std::vector<double> max;
+        std::vector<double> mean;
+    };
+
+    /// One for each value column
+    std::vector<Stats> stats;
+};
+
+/// Group rows by the value of one column, and aggregate real value columns.
+/// Rows with a NaN group value form one group. NaN values are skipped by every
+/// aggregate; a group with none left has a zero sum, and NaN for the rest.
+GroupSummary group_rows(TableSource const&      source,
+                        std::span<size_t const> rows,
+                        size_t                  group_column,
+                        std::span<size_t const> value_columns);
+
+} // namespace noo
+
+#endif // TABLESCAN_H
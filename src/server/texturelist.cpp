@@ -31,14 +31,16 @@ void TextureT::write_new_to(Writer& w) {
 void TextureT::update(TextureData const& data, Writer& w) {
     m_data = data;
 
+    m_parent_list->mark_changed(id());
+
     // we use the same message here
     write_new_to(w);
 }
 
 void TextureT::update(TextureData const& data) {
-    auto w = m_parent_list->new_bcast();
+    m_data = data;
 
-    update(data, *w);
+    m_parent_list->mark_dirty(*this);
 }
 
 void TextureT::write_delete_to(Writer& w) {